@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include "devices/ide.h"
 #include "threads/malloc.h"
+#include "threads/trace.h"
 
 /* A block device. */
 struct block
@@ -121,7 +122,9 @@ void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
   check_sector (block, sector);
+  TRACE_BEGIN (TRACE_BLOCK_READ, block->type, sector);
   block->ops->read (block->aux, sector, buffer);
+  TRACE_END (TRACE_BLOCK_READ, block->type, sector);
   block->read_cnt++;
 }
 
@@ -135,7 +138,9 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
+  TRACE_BEGIN (TRACE_BLOCK_WRITE, block->type, sector);
   block->ops->write (block->aux, sector, buffer);
+  TRACE_END (TRACE_BLOCK_WRITE, block->type, sector);
   block->write_cnt++;
 }
 
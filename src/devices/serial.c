@@ -37,6 +37,14 @@
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable the receive and transmit FIFOs. */
+#define FCR_CLEAR_RX 0x02       /* Clear the receive FIFO. */
+#define FCR_CLEAR_TX 0x04       /* Clear the transmit FIFO. */
+
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* Both set if the FIFOs are enabled. */
+
 /* Line Control Register bits. */
 #define LCR_N81 0x03            /* No parity, 8 data bits, 1 stop bit. */
 #define LCR_DLAB 0x80           /* Divisor Latch Access Bit (DLAB). */
@@ -47,6 +55,7 @@
 /* Line Status Register. */
 #define LSR_DR 0x01             /* Data Ready: received data byte is in RBR. */
 #define LSR_THRE 0x20           /* THR Empty. */
+#define LSR_TEMT 0x40           /* Transmitter Empty, FIFO included. */
 
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
@@ -54,9 +63,15 @@ static enum { UNINIT, POLL, QUEUE } mode;
 /* Data to be transmitted. */
 static struct intq txq;
 
+/* Bytes the transmitter accepts each time it reports THR empty:
+   16 with a working 16550A FIFO, 1 for an 8250 or a 16550 whose
+   FIFO is broken. */
+static int tx_fifo_size;
+
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
 static void write_ier (void);
+static void fill_fifo (void);
 static intr_handler_func serial_interrupt;
 
 /* Initializes the serial port device for polling mode.
@@ -68,7 +83,8 @@ init_poll (void)
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
-  outb (FCR_REG, 0);                    /* Disable FIFO. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX);
+  tx_fifo_size = (inb (IIR_REG) & IIR_FIFO) == IIR_FIFO ? 16 : 1;
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
   intq_init (&txq);
@@ -98,31 +114,53 @@ serial_init_queue (void)
 void
 serial_putc (uint8_t byte) 
 {
+  serial_write (&byte, 1);
+}
+
+/* Sends the N bytes in BUFFER to the serial port.  Interrupts
+   are disabled only once for the whole buffer, and the transmit
+   FIFO is loaded directly if it is idle, so that a short buffer
+   usually needs no transmit interrupt at all. */
+void
+serial_write (const void *buffer, size_t n) 
+{
+  const uint8_t *p = buffer;
   enum intr_level old_level = intr_disable ();
 
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit the bytes. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      while (n-- > 0)
+        putc_poll (*p++); 
     }
   else 
     {
-      /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      /* Otherwise, queue the bytes and update the interrupt
+         enable register. */
+      for (; n > 0; n--, p++) 
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          if (intq_full (&txq)) 
+            {
+              /* Give the hardware what it will take first. */
+              fill_fifo ();
+              if (old_level == INTR_OFF && intq_full (&txq)) 
+                {
+                  /* Interrupts are off and the transmit queue is
+                     full.  If we wanted to wait for the queue to
+                     empty, we'd have to reenable interrupts.
+                     That's impolite, so we'll send a character
+                     via polling instead. */
+                  putc_poll (intq_getc (&txq)); 
+                }
+              else
+                write_ier ();
+            }
+          intq_putc (&txq, *p); 
         }
-
-      intq_putc (&txq, byte); 
+      fill_fifo ();
       write_ier ();
     }
   
@@ -137,6 +175,11 @@ serial_flush (void)
   enum intr_level old_level = intr_disable ();
   while (!intq_empty (&txq))
     putc_poll (intq_getc (&txq));
+
+  /* Let the FIFO drain too, in case we're about to power off. */
+  if (mode != UNINIT)
+    while ((inb (LSR_REG) & LSR_TEMT) == 0)
+      continue;
   intr_set_level (old_level);
 }
 
@@ -193,6 +236,20 @@ write_ier (void)
   outb (IER_REG, ier);
 }
 
+/* If the transmitter is empty, loads it with as many queued
+   bytes as its FIFO holds. */
+static void
+fill_fifo (void) 
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if ((inb (LSR_REG) & LSR_THRE) != 0)
+    for (i = 0; i < tx_fifo_size && !intq_empty (&txq); i++)
+      outb (THR_REG, intq_getc (&txq));
+}
+
 /* Polls the serial port until it's ready,
    and then transmits BYTE. */
 static void
@@ -218,10 +275,9 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* THR empty means the whole transmit FIFO is free, so fill it
+     from the queue without polling the line status per byte. */
+  fill_fifo ();
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
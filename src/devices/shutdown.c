@@ -6,6 +6,7 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
@@ -94,6 +95,7 @@ shutdown_power_off (void)
   filesys_done ();
 #endif
 
+  trace_dump ();
   print_stats ();
 
   printf ("Powering off...\n");
@@ -120,6 +122,8 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  lock_print_stats ();
+  timer_print_profile ();
 #ifdef FILESYS
   block_print_stats ();
 #endif
@@ -17,14 +17,48 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* Number of timer ticks since OS booted.  Only the timer
+   interrupt writes it; ticks_seq lets readers copy all 64 bits
+   without turning interrupts off. */
 static int64_t ticks;
+static struct seqlock ticks_seq;
 
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Sampling profiler.  If timer_profile is nonzero ("-pf"
+   option), the timer interrupts that many times per tick, and
+   each interrupt records the interrupted PC and thread in a
+   hash table of sample counts.  Only every timer_profile'th
+   interrupt counts as a tick, so time keeps its usual rate.
+   timer_print_profile() dumps the table for utils/backtrace. */
+unsigned timer_profile;
+
+/* Highest number of samples per tick, to keep the overhead
+   sane. */
+#define PROFILE_RATE_MAX 20
+
+/* Number of hash table slots, and how many slots are probed for
+   a PC before its sample is dropped. */
+#define PROFILE_SLOTS 4096
+#define PROFILE_PROBES 16
+
+/* Samples taken at one PC in one thread. */
+struct profile_slot
+  {
+    uintptr_t pc;               /* Interrupted PC; 0 if slot unused. */
+    tid_t tid;                  /* Interrupted thread. */
+    unsigned cnt;               /* Number of samples. */
+  };
+
+static struct profile_slot profile_slots[PROFILE_SLOTS];
+static unsigned profile_samples;        /* Samples taken. */
+static unsigned profile_dropped;        /* Samples with no free slot. */
+static unsigned profile_subticks;       /* Interrupts since last tick. */
+
 static intr_handler_func timer_interrupt;
+static void profile_sample (uintptr_t pc, tid_t tid);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -35,7 +69,10 @@ static void real_time_delay (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
-  pit_configure_channel (0, 2, TIMER_FREQ);
+  if (timer_profile > PROFILE_RATE_MAX)
+    timer_profile = PROFILE_RATE_MAX;
+  pit_configure_channel (0, 2, TIMER_FREQ * (timer_profile ? timer_profile : 1));
+  seqlock_init (&ticks_seq);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -70,9 +107,15 @@ timer_calibrate (void)
 int64_t
 timer_ticks (void) 
 {
-  enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
-  intr_set_level (old_level);
+  unsigned seq;
+  int64_t t;
+
+  do
+    {
+      seq = seqlock_read_begin (&ticks_seq);
+      t = ticks;
+    }
+  while (seqlock_read_retry (&ticks_seq, seq));
   return t;
 }
 
@@ -169,11 +212,67 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
+/* Prints the samples taken by the profiler, one line per PC and
+   thread, in a form that "backtrace -p" turns into a flat
+   profile by function. */
+void
+timer_print_profile (void) 
+{
+  size_t i;
+
+  if (timer_profile == 0)
+    return;
+  printf ("Profile: %u samples at %d Hz, %u dropped "
+          "(tid, pc, samples):\n",
+          profile_samples, TIMER_FREQ * timer_profile, profile_dropped);
+  for (i = 0; i < PROFILE_SLOTS; i++) 
+    {
+      struct profile_slot *s = &profile_slots[i];
+      if (s->pc != 0)
+        printf ("Profile: %d 0x%08"PRIxPTR" %u\n", s->tid, s->pc, s->cnt);
+    }
+}
+
+/* Counts a sample at PC in thread TID. */
+static void
+profile_sample (uintptr_t pc, tid_t tid) 
+{
+  unsigned h = (pc ^ (unsigned) tid * 0x9e3779b9u) * 0x9e3779b9u;
+  int i;
+
+  profile_samples++;
+  for (i = 0; i < PROFILE_PROBES; i++) 
+    {
+      struct profile_slot *s = &profile_slots[(h + i) % PROFILE_SLOTS];
+      if (s->pc == 0) 
+        {
+          s->pc = pc;
+          s->tid = tid;
+        }
+      if (s->pc == pc && s->tid == tid) 
+        {
+          s->cnt++;
+          return;
+        }
+    }
+  profile_dropped++;
+}
+
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
+  if (timer_profile != 0) 
+    {
+      profile_sample ((uintptr_t) args->eip, thread_current ()->tid);
+      if (++profile_subticks < timer_profile)
+        return;
+      profile_subticks = 0;
+    }
+
+  seqlock_write_begin (&ticks_seq);
   ticks++;
+  seqlock_write_end (&ticks_seq);
   thread_tick ();
 
 	// if mlfqs
@@ -26,4 +26,8 @@ void timer_ndelay (int64_t nanoseconds);
 
 void timer_print_stats (void);
 
+/* Sampling profiler. */
+extern unsigned timer_profile;
+void timer_print_profile (void);
+
 #endif /* devices/timer.h */
@@ -10,66 +10,151 @@
 void *p_buffer_cache;			// buffer cache를 가리키는 포인터. 동적 할당용
 struct buffer_head buffer_head[BUFFER_CACHE_ENTRY_NB];	// buffer head 
 int clock_hand;		// victim을 가리키는 시계바늘
+// buffer_head들의 valid, sector, clock_bit, ref_cnt와 clock_hand를 보호.
+// 섹터를 찾거나 victim을 고르는 동안만 잡고, 디스크를 읽고 쓰거나 데이터를
+// 복사하는 동안은 그 엔트리의 lock만 잡음. 그래서 한 파일의 cache miss가
+// 다른 파일의 디스크 I/O를 기다리지 않음
+static struct lock bc_lock;
+// 모든 엔트리가 참조중이라 victim을 고를 수 없을 때 기다림
+static struct condition bc_idle;
 
+static struct buffer_head *select_victim(void);
+
+
+// 참조 횟수를 줄임. 0이 되면 victim을 기다리는 스레드를 깨움.
+// bc_lock을 잡고 불러야함
+static void bc_unref(struct buffer_head *target) {
+	ASSERT(0 < target->ref_cnt);
+	if(0 == --target->ref_cnt)
+		cond_signal(&bc_idle, &bc_lock);
+}
+
+// sector_idx를 담고 있는 엔트리를 참조해서 리턴. 없으면 victim을 비워서
+// 그 섹터에 배정함. 참조중인 엔트리는 victim이 되지 않음.
+// 데이터는 아직 안 채워졌을 수 있으므로 bc_lock_entry로 잠근 뒤에 써야 함
+static struct buffer_head *bc_ref(block_sector_t sector_idx) {
+	struct buffer_head *target;
+
+	lock_acquire(&bc_lock);
+	// select_victim이 bc_lock을 놓았다 잡으면 그 사이 다른 스레드가 같은
+	// 섹터를 올렸을 수 있으므로 다시 찾음
+	while(NULL == (target = bc_lookup(sector_idx))) {
+		target = select_victim();
+		if(NULL != target) {
+			target->valid = true;
+			target->loaded = false;
+			target->dirty = false;
+			target->sector = sector_idx;
+			break;
+		}
+	}
+	target->ref_cnt++;
+	target->clock_bit = 1;
+	lock_release(&bc_lock);
+	return target;
+}
+
+// bc_ref로 참조한 엔트리를 잠그고, 배정된 뒤 아직 아무도 채우지 않았으면
+// 채움. READ가 false면 섹터 전체를 덮어쓸 것이므로 디스크에서 읽지 않음.
+// 디스크를 읽는 동안 같은 섹터를 찾는 스레드만 이 lock에서 기다림
+static void bc_lock_entry(struct buffer_head *target, bool read) {
+	lock_acquire(&target->lock);
+	if(false == target->loaded) {
+		if(read)
+			block_read(fs_device, target->sector, target->data);
+		else
+			memset(target->data, 0, BLOCK_SECTOR_SIZE);
+		target->loaded = true;
+	}
+}
+
+// bc_lock_entry로 잠근 엔트리를 풀고 참조를 놓음
+static void bc_release(struct buffer_head *target) {
+	lock_release(&target->lock);
+	lock_acquire(&bc_lock);
+	bc_unref(target);
+	lock_release(&bc_lock);
+}
 
 // sector_idx를 검색, 데이터를 buffer에 저장
+// buffer는 유저 주소일 수 있으므로 엔트리를 잠근 채로 건드리지 않음.
+// 여기서 page fault가 나면 fault 처리 중에 같은 엔트리를 다시 잠글 수 있음.
+// 그래서 스택의 bounce로 먼저 옮기고, 락을 놓은 다음에 buffer로 복사함
 bool bc_read (block_sector_t sector_idx, void* buffer, 
 							off_t bytes_read, int chunk_size, int sector_ofs) {
-	bool success = false;			// 반환 용 값. 성공, 실패를 반환
-	// sector_idx를 먼저 검색한다. 
-	struct buffer_head *target = bc_lookup(sector_idx);
-	// 결과가 없으면 버퍼 캐시에 해당 블록을 넣어야함.
-	if(NULL == target) {
-		// 블록을 넣을 곳을 마련함
-		target = bc_select_victim();
-		target->valid = true;
-		target->dirty = false;
-		target->sector = sector_idx;
-		// 아래 block_read의 용법은 write->file_write->inode_write_at을 볼것
-		// data를 버퍼에 읽음
-		block_read(fs_device, sector_idx, target->data);
-	}
-	// 버퍼 캐시에 넣은 데이터를(이 함수에서 넣었든 원래 있었든) 함수의 두
-	// 번째 인자인 buffer에 넣음
-	memcpy(buffer + bytes_read, target->data + sector_ofs, chunk_size);
-	// clock_bit세팅
-	target->clock_bit = 1;
-	success = true;
-	return success;
+	uint8_t bounce[BLOCK_SECTOR_SIZE];
+	struct buffer_head *target;
+
+	target = bc_ref(sector_idx);
+	bc_lock_entry(target, true);
+	memcpy(bounce, target->data + sector_ofs, chunk_size);
+	bc_release(target);
+
+	memcpy(buffer + bytes_read, bounce, chunk_size);
+	return true;
 }
 
-// 위에 구현한 bc_read와 똑같음
+// buffer의 데이터를 sector_idx의 sector_ofs 위치에 씀.
+// bc_read와 같은 이유로 buffer는 락을 잡기 전에 bounce로 복사해 둠.
+// 섹터 전체를 덮어쓰면 디스크에서 읽어올 필요가 없음
 bool bc_write (block_sector_t sector_idx, void* buffer, 
 							 off_t bytes_written, int chunk_size, int sector_ofs) {
-	bool success = false;			// 반환 용 값. 성공, 실패를 반환
-	// sector_idx를 먼저 검색한다. 
-	struct buffer_head *target = bc_lookup(sector_idx);
-	// 결과가 없으면 버퍼 캐시에 해당 블록을 넣어야함.
-	if(NULL == target) {
-		// 블록을 넣을 곳을 마련함
-		target = bc_select_victim();
-		target->valid = true;
-		target->dirty = false;
-		target->sector = sector_idx;
-		// 아래 block_read의 용법은 write->file_write->inode_write_at을 볼것
-		// data를 버퍼에 읽음
-		block_read(fs_device, sector_idx, target->data);
-	}
-	// 버퍼 캐시에 넣은 데이터를(이 함수에서 넣었든 원래 있었든) 함수의 두
-	// 번째 인자인 buffer에 넣음
-	memcpy(buffer + bytes_written, target->data + sector_ofs, chunk_size);
-	// clock_bit세팅
-	target->clock_bit = 1;
+	uint8_t bounce[BLOCK_SECTOR_SIZE];
+	struct buffer_head *target;
+
+	memcpy(bounce, buffer + bytes_written, chunk_size);
+
+	target = bc_ref(sector_idx);
+	bc_lock_entry(target, chunk_size < BLOCK_SECTOR_SIZE);
+	memcpy(target->data + sector_ofs, bounce, chunk_size);
 	// 이 함수를 불렀다는 것은 곧 dirty_bit가 true가 된다는 뜻
-	target->dirty = true;		
-	success = true;
-	return success;
+	target->dirty = true;
+	bc_release(target);
+	return true;
+}
+
+// src_sector의 src_ofs부터 chunk_size 바이트를 dst_sector의 dst_ofs로 복사.
+// 버퍼 캐시 엔트리끼리 바로 옮기므로 중간 버퍼를 거치지 않음.
+// 둘 다 참조해 두므로 dst를 가져오는 동안 src가 victim이 되지 않음
+bool bc_copy (block_sector_t src_sector, int src_ofs,
+							block_sector_t dst_sector, int dst_ofs, int chunk_size) {
+	bool dst_read = dst_ofs > 0 || chunk_size < BLOCK_SECTOR_SIZE;
+	struct buffer_head *src, *dst;
+
+	src = bc_ref(src_sector);
+	dst = bc_ref(dst_sector);
+	// 두 엔트리는 주소 순서로 잠가서, 반대 방향으로 복사하는 스레드와 서로
+	// 기다리지 않게 함. 같은 섹터면 한 번만 잠금
+	if(src == dst) {
+		lock_acquire(&bc_lock);
+		bc_unref(dst);
+		lock_release(&bc_lock);
+		bc_lock_entry(src, true);
+	}
+	else if(src < dst) {
+		bc_lock_entry(src, true);
+		bc_lock_entry(dst, dst_read);
+	}
+	else {
+		bc_lock_entry(dst, dst_read);
+		bc_lock_entry(src, true);
+	}
+
+	// 같은 섹터 안에서 옮길 수도 있으므로 memmove
+	memmove(dst->data + dst_ofs, src->data + src_ofs, chunk_size);
+	dst->dirty = true;
+	if(src != dst)
+		bc_release(dst);
+	bc_release(src);
+	return true;
 }
 
 // buffer cache 초기화
 void bc_init(void) {
 
 	int i;			// for loop
+	lock_init(&bc_lock);
+	cond_init(&bc_idle);
 	// buffer_cache 동적 할당 block하나는 512bytes
 	p_buffer_cache = malloc(512 * BUFFER_CACHE_ENTRY_NB);
 
@@ -77,7 +162,9 @@ void bc_init(void) {
 	for(i = 0; i < BUFFER_CACHE_ENTRY_NB; i++) {
 		lock_init(&buffer_head[i].lock);
 		buffer_head[i].valid = false;
+		buffer_head[i].loaded = false;
 		buffer_head[i].dirty = false;
+		buffer_head[i].ref_cnt = 0;
 		buffer_head[i].clock_bit = 0;
 		buffer_head[i].data = p_buffer_cache + i * 512;
 	}
@@ -92,42 +179,56 @@ void bc_term(void) {
 	free(p_buffer_cache);
 }
 
-// victim선정후 victim의buffer_head를 반납
-// victim은 dirty이면 flush
-struct buffer_head* bc_select_victim(void) {
-	// 아래는 clock_hand가 victim을 가리키게 함.
-	// 안사용중인 친구가 있으면 그것을,
-	// 전부 가득 차있으면 clock_bit가 0인 친구를
-	while(true) {
+// victim을 골라서 리턴. 참조중인 엔트리는 건너뛰고,
+// 안사용중인 친구가 있으면 그것을, 전부 가득 차있으면 clock_bit가 0인 친구를.
+// 고른 victim이 dirty면 bc_lock을 놓고 flush한 뒤 NULL을 리턴함. 그 사이
+// 찾던 섹터가 다른 엔트리에 올라왔을 수 있으므로 호출한 쪽에서 다시 찾아야
+// 함. 모든 엔트리가 참조중일 때도 하나가 풀릴 때까지 기다린 뒤 NULL.
+// bc_lock을 잡고 불러야함
+static struct buffer_head *select_victim(void) {
+	struct buffer_head *victim = NULL;
+	int i;
+
+	// 첫 바퀴에서 clock_bit를 지우므로 두 바퀴 안에 victim이 나옴.
+	// 못 찾았으면 모두 참조중인 것
+	for(i = 0; i < 2 * BUFFER_CACHE_ENTRY_NB; i++) {
+		struct buffer_head *b = &buffer_head[clock_hand];
+		clock_hand = (clock_hand + 1) % BUFFER_CACHE_ENTRY_NB;
+		if(0 < b->ref_cnt)
+			continue;
 		// 안사용중인 친구를 발견, 당첨!
-		if(buffer_head[clock_hand].valid == false) {
-			return &buffer_head[clock_hand];
-		}
+		if(false == b->valid)
+			return b;
 		// clock_bit가 1이면 0으로
-		if(buffer_head[clock_hand].clock_bit == 1) {
-			buffer_head[clock_hand].clock_bit = 0;
-		}
+		if(1 == b->clock_bit)
+			b->clock_bit = 0;
 		// clock_bit가 0이면 당첨!
 		else {
+			victim = b;
 			break;
 		}
-		clock_hand = (clock_hand + 1) % BUFFER_CACHE_ENTRY_NB;
 	}
-
-	// 찾은 victim을 flush 할 수도 있고, 안 할 수도 있습니다.
-	if(buffer_head[clock_hand].dirty == true) {
-		bc_flush_entry(&buffer_head[clock_hand]);
+	if(NULL == victim) {
+		cond_wait(&bc_idle, &bc_lock);
+		return NULL;
 	}
-	buffer_head[clock_hand].valid = false;
-	buffer_head[clock_hand].dirty = false;
+	if(false == victim->dirty)
+		return victim;
 
-	return &buffer_head[clock_hand];
+	// dirty면 flush하는 동안에도 원래 섹터를 찾을 수 있도록 그대로 두고
+	// 참조만 해서 다른 스레드가 victim으로 고르지 않게 함
+	victim->ref_cnt++;
+	lock_release(&bc_lock);
+	bc_flush_entry(victim);
+	lock_acquire(&bc_lock);
+	bc_unref(victim);
+	return NULL;
 }
 
 
 
 // 버퍼 캐시에 해당 섹터가 존재 하는지 검사
-// 없으면 NULL, 있으면 해당 buffer_head의 주소값
+// 없으면 NULL, 있으면 해당 buffer_head의 주소값. bc_lock을 잡고 불러야함
 struct buffer_head* bc_lookup(block_sector_t sector) {
 	int i = 0;			// for loop
 	struct buffer_head* ret = NULL;
@@ -143,24 +244,33 @@ struct buffer_head* bc_lookup(block_sector_t sector) {
 	return ret;
 }
 
-// 해당 entry의 dirty를 false로세팅 후 disc로 flush
+// 해당 entry가 dirty면 dirty를 false로세팅 후 disc로 flush.
+// 엔트리의 lock만 잡으므로 bc_lock을 잡지 않고, 참조해 둔 채로 불러야함
 void bc_flush_entry(struct buffer_head *p_flush_entry) {
 	lock_acquire(&p_flush_entry->lock);		// 락을 일단 걸음. 공유 자원이므로
-	p_flush_entry->dirty = false;
-	block_write(fs_device, p_flush_entry->sector, p_flush_entry->data);
+	if(true == p_flush_entry->dirty) {
+		p_flush_entry->dirty = false;
+		block_write(fs_device, p_flush_entry->sector, p_flush_entry->data);
+	}
 	lock_release(&p_flush_entry->lock);
 }
 
 // dirty == true인 친구들 모두 flush
 void bc_flush_all_entries(void)	{
 	int i = 0;
-	// 순회하면서 dirty면 flush
+	// 순회하면서 dirty면 flush. 쓰는 동안에는 bc_lock을 놓음
 	for(i = 0; i < BUFFER_CACHE_ENTRY_NB; i++) {
-		if(true == buffer_head[i].dirty) {
-			lock_acquire(&buffer_head[i].lock);
-			buffer_head[i].dirty = false;
-			block_write(fs_device, buffer_head[i].sector, buffer_head[i].data);
-			lock_release(&buffer_head[i].lock);
+		struct buffer_head *b = &buffer_head[i];
+		lock_acquire(&bc_lock);
+		if(false == b->valid || false == b->dirty) {
+			lock_release(&bc_lock);
+			continue;
 		}
+		b->ref_cnt++;
+		lock_release(&bc_lock);
+		bc_flush_entry(b);
+		lock_acquire(&bc_lock);
+		bc_unref(b);
+		lock_release(&bc_lock);
 	}
 }
@@ -8,22 +8,25 @@
 
 bool bc_read (block_sector_t, void*, off_t, int, int);
 bool bc_write (block_sector_t, void*, off_t, int, int);
+bool bc_copy (block_sector_t, int, block_sector_t, int, int);
 struct buffer_head* bc_lookup(block_sector_t); // 버퍼 캐시에 해당 섹터가 
 																							 // 있는지 검사
-struct buffer_head* bc_select_victim(void); // victim선정후 victim의
-																						// buffer_head를 반납
-void bc_flush_entry(struct buffer_head *);  // 해당 entry의 dirty를 false로
+void bc_flush_entry(struct buffer_head *);  // 해당 entry가 dirty면 false로
 																						// 세팅 후 disc로 flush
 void bc_flush_all_entries(void);	// dirty == true인 친구들 모두 flush
 void bc_init(void); // buffer cache 초기화
 void bc_term(void); // 모든 dirty entry flush && buffer cache 해제
 
+// valid, sector, clock_bit, ref_cnt는 bc_lock이, dirty, loaded, data는
+// 엔트리의 lock이 보호함
 struct buffer_head {
 	bool dirty;							// 변경 여부
 	bool valid;							// 사용 여부
+	bool loaded;						// data에 섹터 내용이 채워졌는지. 배정된 직후엔 false
 	block_sector_t sector;	// disc의 sector 번호
 	bool clock_bit;					// clock알고리즘을 위해
-	struct lock lock;				// 공유 자원을 위한 lock
+	int ref_cnt;						// 사용중인 스레드 수. 0보다 크면 victim이 안 됨
+	struct lock lock;				// 데이터와 디스크 I/O를 위한 lock
 	void* data;							// 내가 담당하는 buffer_cache의 주소가 들어있음
 };
 
@@ -8,6 +8,7 @@ struct file
   {
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
+    int ref_cnt;                /* Number of holders, see file_dup(). */
     bool deny_write;            /* Has file_deny_write() been called? */
   };
 
@@ -22,6 +23,7 @@ file_open (struct inode *inode)
     {
       file->inode = inode;
       file->pos = 0;
+      file->ref_cnt = 1;
       file->deny_write = false;
       return file;
     }
@@ -41,11 +43,23 @@ file_reopen (struct file *file)
   return file_open (inode_reopen (file->inode));
 }
 
-/* Closes FILE. */
+/* Returns FILE itself with one more holder, so that it can be
+   stored in a second place that shares its position.  Each
+   holder must call file_close() once. */
+struct file *
+file_dup (struct file *file) 
+{
+  ASSERT (file != NULL);
+  file->ref_cnt++;
+  return file;
+}
+
+/* Closes FILE.  The file is only freed once every holder added
+   by file_dup() has closed it. */
 void
 file_close (struct file *file) 
 {
-  if (file != NULL)
+  if (file != NULL && --file->ref_cnt == 0)
     {
       file_allow_write (file);
       inode_close (file->inode);
@@ -113,6 +127,23 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Copies SIZE bytes from IN into OUT, starting at each file's
+   current position, without going through a caller's buffer.
+   Returns the number of bytes actually copied,
+   which may be less than SIZE if end of either file is reached.
+   (Normally we'd grow OUT in that case, but file growth is not
+   yet implemented.)
+   Advances both files' positions by the number of bytes copied. */
+off_t
+file_copy (struct file *in, struct file *out, off_t size) 
+{
+  off_t bytes_copied = inode_copy_range (in->inode, in->pos,
+                                         out->inode, out->pos, size);
+  in->pos += bytes_copied;
+  out->pos += bytes_copied;
+  return bytes_copied;
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -7,10 +7,17 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/buffer_cache.h"
+#include "threads/synch.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+/* Held to write while the directory is changed and to read while
+   it is searched, so that a name is never seen half added or half
+   removed but lookups run side by side.  File data is locked per
+   inode instead; see inode.c. */
+static struct rwlock dir_lock;
+
 static void do_format (void);
 
 /* Initializes the file system module.
@@ -23,6 +30,7 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
 	bc_init();
+  rwlock_init (&dir_lock);
   inode_init ();
   free_map_init ();
 
@@ -49,14 +57,19 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  struct dir *dir;
+  bool success;
+
+  rwlock_acquire_write (&dir_lock);
+  dir = dir_open_root ();
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && inode_create (inode_sector, initial_size)
+             && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  rwlock_release_write (&dir_lock);
 
   return success;
 }
@@ -69,12 +82,15 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  struct dir *dir;
   struct inode *inode = NULL;
 
+  rwlock_acquire_read (&dir_lock);
+  dir = dir_open_root ();
   if (dir != NULL)
     dir_lookup (dir, name, &inode);
   dir_close (dir);
+  rwlock_release_read (&dir_lock);
 
   return file_open (inode);
 }
@@ -86,9 +102,14 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  struct dir *dir;
+  bool success;
+
+  rwlock_acquire_write (&dir_lock);
+  dir = dir_open_root ();
+  success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
+  rwlock_release_write (&dir_lock);
 
   return success;
 }
@@ -7,6 +7,7 @@
 #include "filesys/buffer_cache.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -38,6 +39,7 @@ struct inode
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
+    struct rwlock rw;                   /* Guards data and deny_write_cnt. */
   };
 
 /* Returns the block device sector that contains byte offset POS
@@ -58,11 +60,16 @@ byte_to_sector (const struct inode *inode, off_t pos)
    returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Protects open_inodes and the open_cnt and removed members of
+   every inode on it. */
+static struct lock open_inodes_lock;
+
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -115,6 +122,8 @@ inode_open (block_sector_t sector)
   struct list_elem *e;
   struct inode *inode;
 
+  lock_acquire (&open_inodes_lock);
+
   /* Check whether this inode is already open. */
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
        e = list_next (e)) 
@@ -122,7 +131,8 @@ inode_open (block_sector_t sector)
       inode = list_entry (e, struct inode, elem);
       if (inode->sector == sector) 
         {
-          inode_reopen (inode);
+          inode->open_cnt++;
+          lock_release (&open_inodes_lock);
           return inode; 
         }
     }
@@ -130,7 +140,10 @@ inode_open (block_sector_t sector)
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
   list_push_front (&open_inodes, &inode->elem);
@@ -138,7 +151,9 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
+  rwlock_init (&inode->rw);
   block_read (fs_device, inode->sector, &inode->data);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -147,7 +162,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -169,10 +188,13 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
+  lock_acquire (&open_inodes_lock);
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
+      /* Remove from inode list and release lock.  No one else can
+         reach INODE now, so the rest needs no lock. */
       list_remove (&inode->elem);
+      lock_release (&open_inodes_lock);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
@@ -184,6 +206,8 @@ inode_close (struct inode *inode)
 
       free (inode); 
     }
+  else
+    lock_release (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -192,7 +216,9 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&open_inodes_lock);
   inode->removed = true;
+  lock_release (&open_inodes_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -203,8 +229,8 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  rwlock_acquire_read (&inode->rw);
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -221,34 +247,16 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-			bc_read(sector_idx, (void *)buffer, bytes_read, chunk_size, sector_ofs);
+      /* The buffer cache copies just the chunk, whole or partial
+         sector alike. */
+      bc_read (sector_idx, buffer, bytes_read, chunk_size, sector_ofs);
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          // Read full sector directly into caller's buffer. 
-          //block_read (fs_device, sector_idx, buffer + bytes_read);
-					bc_read(sector_idx, (void *)buffer, bytes_read, chunk_size, sector_ofs);
-        }
-      else 
-        {
-          // Read sector into bounce buffer, then partially copy
-          // into caller's buffer. 
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-         // block_read (fs_device, sector_idx, bounce);
-					bc_read(sector_idx, (void *)buffer, bytes_read, chunk_size, sector_ofs);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+  rwlock_release_read (&inode->rw);
 
   return bytes_read;
 }
@@ -264,10 +272,13 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
+  rwlock_acquire_write (&inode->rw);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      rwlock_release_write (&inode->rw);
+      return 0;
+    }
 
   while (size > 0) 
     {
@@ -285,50 +296,101 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          // Write full sector directly to disk. 
-          //block_write (fs_device, sector_idx, buffer + bytes_written);
-					bc_write(sector_idx, (void *)buffer, bytes_written, chunk_size, sector_ofs);
-        }
-      else 
-        {
-          // We need a bounce buffer. 
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
+      /* The buffer cache reads in the rest of a partially
+         written sector itself, so no bounce buffer is needed. */
+      bc_write (sector_idx, (void *) buffer, bytes_written, chunk_size,
+                sector_ofs);
 
-          // If the sector contains data before or after the chunk
-          //   we're writing, then we need to read in the sector
-          //   first.  Otherwise we start with a sector of all zeros. 
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          //block_write (fs_device, sector_idx, bounce);
-					bc_write(sector_idx, (void *)buffer, bytes_written, chunk_size, sector_ofs);
-        }
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+  rwlock_release_write (&inode->rw);
 
   return bytes_written;
 }
 
+/* Copies SIZE bytes from IN, starting at IN_OFS, into OUT,
+   starting at OUT_OFS.  The data moves from one buffer cache
+   entry to another without passing through a caller's buffer.
+   Returns the number of bytes actually copied, which may be less
+   than SIZE if the end of either inode is reached.  (Normally a
+   copy past the end of OUT would extend it, but growth is not
+   yet implemented.) */
+off_t
+inode_copy_range (struct inode *in, off_t in_ofs,
+                  struct inode *out, off_t out_ofs, off_t size)
+{
+  off_t bytes_copied = 0;
+
+  /* Lock IN for reading and OUT for writing.  Two inodes are
+     always locked in sector order, so that two copies in opposite
+     directions cannot deadlock. */
+  if (in == out)
+    rwlock_acquire_write (&out->rw);
+  else if (in->sector < out->sector)
+    {
+      rwlock_acquire_read (&in->rw);
+      rwlock_acquire_write (&out->rw);
+    }
+  else
+    {
+      rwlock_acquire_write (&out->rw);
+      rwlock_acquire_read (&in->rw);
+    }
+
+  if (out->deny_write_cnt)
+    size = 0;
+
+  while (size > 0)
+    {
+      /* Sectors to copy between, starting offsets within them. */
+      block_sector_t in_sector = byte_to_sector (in, in_ofs);
+      block_sector_t out_sector = byte_to_sector (out, out_ofs);
+      int in_sector_ofs = in_ofs % BLOCK_SECTOR_SIZE;
+      int out_sector_ofs = out_ofs % BLOCK_SECTOR_SIZE;
+
+      /* Bytes left in either inode or either sector, least of all. */
+      off_t in_left = inode_length (in) - in_ofs;
+      off_t out_left = inode_length (out) - out_ofs;
+      off_t min_left = in_left < out_left ? in_left : out_left;
+      int sector_left = BLOCK_SECTOR_SIZE
+                        - (in_sector_ofs > out_sector_ofs
+                           ? in_sector_ofs : out_sector_ofs);
+      if (sector_left < min_left)
+        min_left = sector_left;
+
+      /* Number of bytes to actually copy in this step. */
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+      bc_copy (in_sector, in_sector_ofs, out_sector, out_sector_ofs,
+               chunk_size);
+
+      /* Advance. */
+      size -= chunk_size;
+      in_ofs += chunk_size;
+      out_ofs += chunk_size;
+      bytes_copied += chunk_size;
+    }
+
+  if (in != out)
+    rwlock_release_read (&in->rw);
+  rwlock_release_write (&out->rw);
+  return bytes_copied;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -337,12 +399,15 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rw);
 }
 
-/* Returns the length, in bytes, of INODE's data. */
+/* Returns the length, in bytes, of INODE's data.  Files do not
+   grow, so this needs no lock. */
 off_t
 inode_length (const struct inode *inode)
 {
@@ -3,6 +3,7 @@
 #include <random.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Converts a string representation of a signed decimal integer
    in S into an `int', which is returned. */
@@ -61,21 +62,62 @@ qsort (void *array, size_t cnt, size_t size,
   sort (array, cnt, size, compare_thunk, &compare);
 }
 
+/* Comparison function type used by the sorts below. */
+typedef int compare_func (const void *, const void *, void *aux);
+
+/* Partitions of at most this many elements are finished with
+   insertion sort, which beats partitioning on short runs. */
+#define INSERTION_MAX 16
+
+/* Words used to swap elements.  They may overlay elements of any
+   type; x86 does not require them to be aligned. */
+typedef uint32_t word32_t __attribute__ ((may_alias));
+typedef uint64_t word64_t __attribute__ ((may_alias));
+
+/* Swaps the elements of SIZE bytes at A and B.  Elements of 4
+   and 8 bytes, the common cases of ints and pointers and of
+   64-bit keys, are swapped as single words; other sizes a word
+   at a time with a byte tail. */
+static inline void
+swap_elems (unsigned char *a, unsigned char *b, size_t size)
+{
+  if (size == sizeof (word32_t)) 
+    {
+      word32_t t = *(word32_t *) a;
+      *(word32_t *) a = *(word32_t *) b;
+      *(word32_t *) b = t;
+    }
+  else if (size == sizeof (word64_t)) 
+    {
+      word64_t t = *(word64_t *) a;
+      *(word64_t *) a = *(word64_t *) b;
+      *(word64_t *) b = t;
+    }
+  else 
+    {
+      for (; size >= sizeof (word32_t); size -= sizeof (word32_t)) 
+        {
+          word32_t t = *(word32_t *) a;
+          *(word32_t *) a = *(word32_t *) b;
+          *(word32_t *) b = t;
+          a += sizeof (word32_t);
+          b += sizeof (word32_t);
+        }
+      for (; size > 0; size--) 
+        {
+          unsigned char t = *a;
+          *a++ = *b;
+          *b++ = t;
+        }
+    }
+}
+
 /* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
    with elements of SIZE bytes each. */
 static void
 do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
 {
-  unsigned char *a = array + (a_idx - 1) * size;
-  unsigned char *b = array + (b_idx - 1) * size;
-  size_t i;
-
-  for (i = 0; i < size; i++)
-    {
-      unsigned char t = a[i];
-      a[i] = b[i];
-      b[i] = t;
-    }
+  swap_elems (array + (a_idx - 1) * size, array + (b_idx - 1) * size, size);
 }
 
 /* Compares elements with 1-based indexes A_IDX and B_IDX in
@@ -84,8 +126,7 @@ do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
    strcmp()-type result. */
 static int
 do_compare (unsigned char *array, size_t a_idx, size_t b_idx, size_t size,
-            int (*compare) (const void *, const void *, void *aux),
-            void *aux) 
+            compare_func *compare, void *aux) 
 {
   return compare (array + (a_idx - 1) * size, array + (b_idx - 1) * size, aux);
 }
@@ -95,8 +136,7 @@ do_compare (unsigned char *array, size_t a_idx, size_t b_idx, size_t size,
    elements, passing AUX as auxiliary data. */
 static void
 heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
-         int (*compare) (const void *, const void *, void *aux),
-         void *aux) 
+         compare_func *compare, void *aux) 
 {
   for (;;) 
     {
@@ -122,35 +162,277 @@ heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
     }
 }
 
+/* Heapsorts ARRAY of CNT elements of SIZE bytes each.  Used when
+   introsort partitions badly, to bound it to O(n lg n). */
+static void
+heap_sort (unsigned char *array, size_t cnt, size_t size,
+           compare_func *compare, void *aux) 
+{
+  size_t i;
+
+  /* Build a heap. */
+  for (i = cnt / 2; i > 0; i--)
+    heapify (array, i, cnt, size, compare, aux);
+
+  /* Sort the heap. */
+  for (i = cnt; i > 1; i--) 
+    {
+      do_swap (array, 1, i, size);
+      heapify (array, 1, i - 1, size, compare, aux); 
+    }
+}
+
+/* Insertion sorts ARRAY of CNT elements of SIZE bytes each.
+   Only moves an element past strictly greater ones, so it is
+   stable. */
+static void
+insertion_sort (unsigned char *array, size_t cnt, size_t size,
+                compare_func *compare, void *aux) 
+{
+  unsigned char *end = array + cnt * size;
+  unsigned char *i, *j;
+
+  for (i = array + size; i < end; i += size)
+    for (j = i; j > array && compare (j - size, j, aux) > 0; j -= size)
+      swap_elems (j - size, j, size);
+}
+
+/* Swaps into RESULT the median of the elements at A, B and C. */
+static void
+move_median_to_first (unsigned char *result, unsigned char *a,
+                      unsigned char *b, unsigned char *c, size_t size,
+                      compare_func *compare, void *aux) 
+{
+  unsigned char *median;
+
+  if (compare (a, b, aux) < 0) 
+    {
+      if (compare (b, c, aux) < 0)
+        median = b;
+      else if (compare (a, c, aux) < 0)
+        median = c;
+      else
+        median = a;
+    }
+  else if (compare (a, c, aux) < 0)
+    median = a;
+  else if (compare (b, c, aux) < 0)
+    median = c;
+  else
+    median = b;
+  swap_elems (result, median, size);
+}
+
+/* Partitions the elements in [FIRST, LAST) around the pivot at
+   PIVOT, which lies outside the range, and returns the start of
+   the upper part.  The range must contain elements both no less
+   and no greater than the pivot, which stop the scans without
+   bounds checks. */
+static unsigned char *
+partition (unsigned char *first, unsigned char *last, unsigned char *pivot,
+           size_t size, compare_func *compare, void *aux) 
+{
+  for (;;) 
+    {
+      while (compare (first, pivot, aux) < 0)
+        first += size;
+      last -= size;
+      while (compare (pivot, last, aux) < 0)
+        last -= size;
+      if (first >= last)
+        return first;
+      swap_elems (first, last, size);
+      first += size;
+    }
+}
+
+/* Introsorts ARRAY of CNT elements of SIZE bytes each, falling
+   back to heapsort once DEPTH levels of partitioning have been
+   used up.  Recurses into the smaller part and loops on the
+   larger, so the stack stays O(lg n) deep. */
+static void
+introsort (unsigned char *array, size_t cnt, size_t size,
+           compare_func *compare, void *aux, int depth) 
+{
+  while (cnt > INSERTION_MAX) 
+    {
+      unsigned char *end = array + cnt * size;
+      unsigned char *cut;
+      size_t lower;
+
+      if (depth-- == 0) 
+        {
+          heap_sort (array, cnt, size, compare, aux);
+          return;
+        }
+
+      /* Use the median of the second, middle and last elements
+         as pivot, parked in the first element. */
+      move_median_to_first (array, array + size, array + cnt / 2 * size,
+                            end - size, size, compare, aux);
+      cut = partition (array + size, end, array, size, compare, aux);
+
+      lower = (cut - array) / size;
+      if (lower < cnt - lower) 
+        {
+          introsort (array, lower, size, compare, aux, depth);
+          array = cut;
+          cnt -= lower;
+        }
+      else 
+        {
+          introsort (cut, cnt - lower, size, compare, aux, depth);
+          cnt = lower;
+        }
+    }
+  insertion_sort (array, cnt, size, compare, aux);
+}
+
 /* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
    using COMPARE to compare elements, passing AUX as auxiliary
    data.  When COMPARE is passed a pair of elements A and B,
    respectively, it must return a strcmp()-type result, i.e. less
    than zero if A < B, zero if A == B, greater than zero if A >
-   B.  Runs in O(n lg n) time and O(1) space in CNT. */
+   B.  Runs in O(n lg n) time and O(lg n) space in CNT.  The sort
+   is not stable; see sort_stable(). */
 void
 sort (void *array, size_t cnt, size_t size,
       int (*compare) (const void *, const void *, void *aux),
       void *aux) 
 {
-  size_t i;
+  int depth = 0;
+  size_t n;
 
   ASSERT (array != NULL || cnt == 0);
   ASSERT (compare != NULL);
   ASSERT (size > 0);
 
-  /* Build a heap. */
-  for (i = cnt / 2; i > 0; i--)
-    heapify (array, i, cnt, size, compare, aux);
+  for (n = cnt; n > 1; n /= 2)
+    depth += 2;
+  introsort (array, cnt, size, compare, aux, depth);
+}
 
-  /* Sort the heap. */
-  for (i = cnt; i > 1; i--) 
+/* Reverses the CNT elements of SIZE bytes each at ARRAY. */
+static void
+reverse (unsigned char *array, size_t cnt, size_t size) 
+{
+  unsigned char *a = array;
+  unsigned char *b = array + cnt * size;
+
+  while (cnt > 1) 
     {
-      do_swap (array, 1, i, size);
-      heapify (array, 1, i - 1, size, compare, aux); 
+      b -= size;
+      swap_elems (a, b, size);
+      a += size;
+      cnt -= 2;
     }
 }
 
+/* Exchanges the CNT_A elements at A with the CNT_B elements
+   following them, of SIZE bytes each. */
+static void
+rotate (unsigned char *a, size_t cnt_a, size_t cnt_b, size_t size) 
+{
+  reverse (a, cnt_a, size);
+  reverse (a + cnt_a * size, cnt_b, size);
+  reverse (a, cnt_a + cnt_b, size);
+}
+
+/* Returns the number of elements among the CNT at ARRAY that
+   are less than KEY, or no greater than KEY if UPPER is true.
+   ARRAY must be sorted. */
+static size_t
+bound (unsigned char *array, size_t cnt, const unsigned char *key,
+       bool upper, size_t size, compare_func *compare, void *aux) 
+{
+  size_t lo = 0, hi = cnt;
+
+  while (lo < hi) 
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      int cmp = compare (array + mid * size, key, aux);
+      if (cmp < 0 || (upper && cmp == 0))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Stably merges the sorted runs of CNT_A elements at A and CNT_B
+   elements following them, in place.  Splits the longer run in
+   half, finds where its middle element falls in the other run,
+   rotates the two inner pieces into place and merges each side,
+   for O(n lg n) time without a buffer. */
+static void
+merge (unsigned char *a, size_t cnt_a, size_t cnt_b, size_t size,
+       compare_func *compare, void *aux) 
+{
+  while (cnt_a > 0 && cnt_b > 0) 
+    {
+      unsigned char *b = a + cnt_a * size;
+      size_t cut_a, cut_b;
+
+      if (cnt_a + cnt_b == 2) 
+        {
+          if (compare (b, a, aux) < 0)
+            swap_elems (a, b, size);
+          return;
+        }
+
+      /* Elements of the first run go before equal elements of
+         the second. */
+      if (cnt_a > cnt_b) 
+        {
+          cut_a = cnt_a / 2;
+          cut_b = bound (b, cnt_b, a + cut_a * size, false,
+                         size, compare, aux);
+        }
+      else 
+        {
+          cut_b = cnt_b / 2;
+          cut_a = bound (a, cnt_a, b + cut_b * size, true,
+                         size, compare, aux);
+        }
+      rotate (a + cut_a * size, cnt_a - cut_a, cut_b, size);
+
+      /* Recurse into the left side and loop on the right. */
+      merge (a, cut_a, cut_b, size, compare, aux);
+      a += (cut_a + cut_b) * size;
+      cnt_a -= cut_a;
+      cnt_b -= cut_b;
+    }
+}
+
+/* Sorts ARRAY like sort(), except that elements that compare
+   equal keep their original relative order.  Insertion sorts
+   short runs, then merges them bottom-up in place, so it needs
+   no memory beyond the array but takes O(n lg^2 n) time in
+   CNT. */
+void
+sort_stable (void *array_, size_t cnt, size_t size,
+             int (*compare) (const void *, const void *, void *aux),
+             void *aux) 
+{
+  unsigned char *array = array_;
+  size_t run, i;
+
+  ASSERT (array != NULL || cnt == 0);
+  ASSERT (compare != NULL);
+  ASSERT (size > 0);
+
+  for (i = 0; i < cnt; i += INSERTION_MAX)
+    insertion_sort (array + i * size,
+                    cnt - i < INSERTION_MAX ? cnt - i : INSERTION_MAX,
+                    size, compare, aux);
+
+  for (run = INSERTION_MAX; run < cnt; run *= 2)
+    for (i = 0; i + run < cnt; i += 2 * run)
+      merge (array + i * size, run,
+             cnt - (i + run) < run ? cnt - (i + run) : run,
+             size, compare, aux);
+}
+
 /* Searches ARRAY, which contains CNT elements of SIZE bytes
    each, for the given KEY.  Returns a match is found, otherwise
    a null pointer.  If there are multiple matches, returns an
@@ -1,5 +1,25 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* The block functions below move whole 32-bit words once the
+   destination is word-aligned, falling back to bytes for the
+   unaligned head and the tail.  x86 allows unaligned loads, so
+   only one side needs to be aligned.  Blocks shorter than
+   WORD_MIN bytes are not worth the setup and use bytes only.
+
+   Words are accessed through a may_alias type so that they can
+   overlay data of any type. */
+typedef uint32_t word_t __attribute__ ((may_alias));
+#define WORD_SIZE sizeof (word_t)
+#define WORD_MIN 16
+
+/* A word with every byte equal to 0x01, and to 0x80. */
+#define ONES ((word_t) 0x01010101)
+#define HIGHS ((word_t) 0x80808080)
+
+/* True if any byte of word W is zero. */
+#define HAS_ZERO(W) ((((W) - ONES) & ~(W) & HIGHS) != 0)
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,6 +32,17 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
+  if (size >= WORD_MIN) 
+    {
+      size_t words;
+
+      for (; (uintptr_t) dst % WORD_SIZE != 0; size--)
+        *dst++ = *src++;
+      words = size / WORD_SIZE;
+      size %= WORD_SIZE;
+      asm volatile ("rep movsl"
+                    : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+    }
   while (size-- > 0)
     *dst++ = *src++;
 
@@ -29,20 +60,34 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  if (dst < src) 
-    {
-      while (size-- > 0)
-        *dst++ = *src++;
-    }
-  else 
+  /* Copying forward is safe unless DST starts inside SRC. */
+  if (dst <= src || dst >= src + size)
+    return memcpy (dst_, src_, size);
+
+  dst += size;
+  src += size;
+  if (size >= WORD_MIN) 
     {
-      dst += size;
-      src += size;
-      while (size-- > 0)
+      size_t words;
+
+      for (; (uintptr_t) dst % WORD_SIZE != 0; size--)
         *--dst = *--src;
+      words = size / WORD_SIZE;
+      size %= WORD_SIZE;
+
+      /* Copy downward from the last word.  Interrupt entry
+         clears the direction flag, so setting it here is safe. */
+      dst -= WORD_SIZE;
+      src -= WORD_SIZE;
+      asm volatile ("std; rep movsl; cld"
+                    : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+      dst += WORD_SIZE;
+      src += WORD_SIZE;
     }
+  while (size-- > 0)
+    *--dst = *--src;
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -58,6 +103,10 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  /* Skip equal words, then find the differing byte. */
+  for (; size >= WORD_SIZE; a += WORD_SIZE, b += WORD_SIZE, size -= WORD_SIZE)
+    if (*(const word_t *) a != *(const word_t *) b)
+      break;
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -281,7 +330,19 @@ memset (void *dst_, int value, size_t size)
   unsigned char *dst = dst_;
 
   ASSERT (dst != NULL || size == 0);
-  
+
+  if (size >= WORD_MIN) 
+    {
+      word_t word = (unsigned char) value * ONES;
+      size_t words;
+
+      for (; (uintptr_t) dst % WORD_SIZE != 0; size--)
+        *dst++ = value;
+      words = size / WORD_SIZE;
+      size %= WORD_SIZE;
+      asm volatile ("rep stosl"
+                    : "+D" (dst), "+c" (words) : "a" (word) : "memory");
+    }
   while (size-- > 0)
     *dst++ = value;
 
@@ -293,10 +354,19 @@ size_t
 strlen (const char *string) 
 {
   const char *p;
+  const word_t *w;
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
+  /* Reach a word boundary, then scan a word at a time.  An
+     aligned word never crosses a page boundary, so reading past
+     the terminator cannot fault. */
+  for (p = string; (uintptr_t) p % WORD_SIZE != 0; p++)
+    if (*p == '\0')
+      return p - string;
+  for (w = (const word_t *) p; !HAS_ZERO (*w); w++)
+    continue;
+  for (p = (const char *) w; *p != '\0'; p++)
     continue;
   return p - string;
 }
@@ -3,6 +3,34 @@
 #include <syscall.h>
 #include <syscall-nr.h>
 
+/* Output written through the functions below is buffered per
+   file handle, so that a line of output costs one write()
+   instead of one per character or per printf() call.  The
+   console is line buffered; other handles are written through
+   unless hsetvbuf() gives them a buffer.  The buffers are
+   flushed by exit() and before reading the keyboard, forking or
+   executing a program, so that output stays in order. */
+
+/* Number of handles that may be buffered at once. */
+#define STREAM_CNT 4
+
+/* A buffered file handle. */
+struct stream 
+  {
+    int handle;                 /* File handle. */
+    int mode;                   /* _IOLBF or _IOFBF; _IONBF if free. */
+    size_t len;                 /* Bytes waiting in BUF. */
+    char buf[512];              /* Output buffer. */
+  };
+
+static struct stream streams[STREAM_CNT] = 
+  {
+    { STDOUT_FILENO, _IOLBF, 0, {0} },
+  };
+
+static struct stream *find_stream (int handle);
+static void output (int handle, const char *, size_t);
+
 /* The standard vprintf() function,
    which is like printf() but uses a va_list. */
 int
@@ -30,8 +58,8 @@ hprintf (int handle, const char *format, ...)
 int
 puts (const char *s) 
 {
-  write (STDOUT_FILENO, s, strlen (s));
-  putchar ('\n');
+  output (STDOUT_FILENO, s, strlen (s));
+  output (STDOUT_FILENO, "\n", 1);
 
   return 0;
 }
@@ -41,9 +69,106 @@ int
 putchar (int c) 
 {
   char c2 = c;
-  write (STDOUT_FILENO, &c2, 1);
+  output (STDOUT_FILENO, &c2, 1);
   return c;
 }
+
+/* Sets the buffering of HANDLE to MODE, one of _IONBF, _IOLBF
+   or _IOFBF, flushing any output already buffered for it.
+   Returns 0 if successful, -1 if MODE is invalid or too many
+   handles are already buffered. */
+int
+hsetvbuf (int handle, int mode) 
+{
+  struct stream *s = find_stream (handle);
+
+  if (mode != _IONBF && mode != _IOLBF && mode != _IOFBF)
+    return -1;
+  if (s != NULL) 
+    hflush (handle);
+  else if (mode != _IONBF) 
+    {
+      s = find_stream (-1);
+      if (s == NULL)
+        return -1;
+      s->handle = handle;
+      s->len = 0;
+    }
+  if (s != NULL)
+    s->mode = mode;
+  return 0;
+}
+
+/* Writes out any output buffered for HANDLE.  Returns 0. */
+int
+hflush (int handle) 
+{
+  struct stream *s = find_stream (handle);
+
+  if (s != NULL && s->len > 0) 
+    {
+      write (s->handle, s->buf, s->len);
+      s->len = 0;
+    }
+  return 0;
+}
+
+/* Writes out the output buffered for every handle. */
+void
+hflush_all (void) 
+{
+  struct stream *s;
+
+  for (s = streams; s < streams + STREAM_CNT; s++)
+    if (s->mode != _IONBF)
+      hflush (s->handle);
+}
+
+/* Returns the buffer for HANDLE, or a null pointer if HANDLE is
+   not buffered.  If HANDLE is -1, returns a free buffer. */
+static struct stream *
+find_stream (int handle) 
+{
+  struct stream *s;
+
+  for (s = streams; s < streams + STREAM_CNT; s++)
+    if (handle == -1 ? s->mode == _IONBF
+        : s->mode != _IONBF && s->handle == handle)
+      return s;
+  return NULL;
+}
+
+/* Writes the SIZE bytes in BUFFER to HANDLE, through its buffer
+   if it has one. */
+static void
+output (int handle, const char *buffer, size_t size) 
+{
+  struct stream *s = find_stream (handle);
+  bool newline = false;
+
+  if (s == NULL) 
+    {
+      write (handle, buffer, size);
+      return;
+    }
+
+  /* Output too big for the buffer goes straight through. */
+  if (s->len + size > sizeof s->buf) 
+    {
+      hflush (handle);
+      if (size >= sizeof s->buf) 
+        {
+          write (handle, buffer, size);
+          return;
+        }
+    }
+  if (s->mode == _IOLBF)
+    newline = memchr (buffer, '\n', size) != NULL;
+  memcpy (s->buf + s->len, buffer, size);
+  s->len += size;
+  if (newline)
+    hflush (handle);
+}
 
 /* Auxiliary data for vhprintf_helper(). */
 struct vhprintf_aux 
@@ -89,6 +214,6 @@ static void
 flush (struct vhprintf_aux *aux)
 {
   if (aux->p > aux->buf)
-    write (aux->handle, aux->buf, aux->p - aux->buf);
+    output (aux->handle, aux->buf, aux->p - aux->buf);
   aux->p = aux->buf;
 }
@@ -0,0 +1,412 @@
+#include <malloc.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A malloc() for user programs, built on sbrk().
+
+   Like the kernel's malloc() in threads/malloc.c, requests of up
+   to 1 kB are rounded up to a power of 2 and served from the
+   free list of the "descriptor" for that size class.  An empty
+   free list is refilled by carving a one-page "arena" into
+   blocks, and an arena whose blocks are all free again is given
+   back.  Bigger requests get a run of whole pages with the size
+   kept in the arena header at their start.
+
+   Pages come from a list of free page runs sorted by address.
+   A freed run is coalesced with the runs on either side of it,
+   and once the run at the top of the heap is big enough it is
+   returned to the kernel by moving the break back down.  Only
+   when no run is big enough is the heap grown with sbrk(). */
+
+/* Size of a page. */
+#define PAGE_SIZE 4096
+
+/* Free pages at the top of the heap are returned to the kernel
+   once there are at least this many. */
+#define TRIM_PAGES 16
+
+/* Free block, linked into its descriptor's free list. */
+struct block 
+  {
+    struct block *prev;         /* Previous free block. */
+    struct block *next;         /* Next free block. */
+  };
+
+/* Descriptor. */
+struct desc
+  {
+    size_t block_size;          /* Size of each element in bytes. */
+    size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    struct block *free_list;    /* List of free blocks. */
+  };
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x9a548eed
+
+/* Arena. */
+struct arena 
+  {
+    unsigned magic;             /* Always set to ARENA_MAGIC. */
+    struct desc *desc;          /* Owning descriptor, null for big block. */
+    size_t free_cnt;            /* Free blocks; pages in big block. */
+  };
+
+/* Run of free pages. */
+struct run 
+  {
+    size_t page_cnt;            /* Number of pages in the run. */
+    struct run *next;           /* Next run, at a higher address. */
+  };
+
+/* Our set of descriptors, for block sizes 16 through 1024. */
+#define DESC_CNT 7
+static struct desc descs[DESC_CNT];
+static bool descs_initialized;
+
+/* Free page runs, in address order. */
+static struct run *free_runs;
+
+static struct arena *block_to_arena (struct block *);
+static struct block *arena_to_block (struct arena *, size_t idx);
+static void *get_pages (size_t page_cnt);
+static void put_pages (void *, size_t page_cnt);
+
+/* Initializes the descriptors. */
+static void
+init_descs (void) 
+{
+  size_t i;
+
+  for (i = 0; i < DESC_CNT; i++) 
+    {
+      struct desc *d = &descs[i];
+      d->block_size = 16 << i;
+      d->blocks_per_arena = (PAGE_SIZE - sizeof (struct arena)) / d->block_size;
+      d->free_list = NULL;
+    }
+  descs_initialized = true;
+}
+
+/* Adds B to the front of D's free list. */
+static void
+push_block (struct desc *d, struct block *b) 
+{
+  b->prev = NULL;
+  b->next = d->free_list;
+  if (b->next != NULL)
+    b->next->prev = b;
+  d->free_list = b;
+}
+
+/* Removes B from D's free list. */
+static void
+remove_block (struct desc *d, struct block *b) 
+{
+  if (b->prev != NULL)
+    b->prev->next = b->next;
+  else
+    d->free_list = b->next;
+  if (b->next != NULL)
+    b->next->prev = b->prev;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size) 
+{
+  struct desc *d;
+  struct block *b;
+  struct arena *a;
+
+  /* A null pointer satisfies a request for 0 bytes. */
+  if (size == 0)
+    return NULL;
+
+  if (!descs_initialized)
+    init_descs ();
+
+  /* Find the smallest descriptor that satisfies a SIZE-byte
+     request. */
+  for (d = descs; d < descs + DESC_CNT; d++)
+    if (d->block_size >= size)
+      break;
+  if (d == descs + DESC_CNT) 
+    {
+      /* SIZE is too big for any descriptor.
+         Allocate enough pages to hold SIZE plus an arena. */
+      size_t page_cnt;
+
+      if (size > SIZE_MAX - sizeof *a - PAGE_SIZE)
+        return NULL;
+      page_cnt = DIV_ROUND_UP (size + sizeof *a, PAGE_SIZE);
+      a = get_pages (page_cnt);
+      if (a == NULL)
+        return NULL;
+
+      /* Initialize the arena to indicate a big block of PAGE_CNT
+         pages, and return it. */
+      a->magic = ARENA_MAGIC;
+      a->desc = NULL;
+      a->free_cnt = page_cnt;
+      return a + 1;
+    }
+
+  /* If the free list is empty, create a new arena. */
+  if (d->free_list == NULL)
+    {
+      size_t i;
+
+      a = get_pages (1);
+      if (a == NULL) 
+        return NULL; 
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = d->blocks_per_arena; i-- > 0; ) 
+        push_block (d, arena_to_block (a, i));
+    }
+
+  /* Get a block from free list and return it. */
+  b = d->free_list;
+  remove_block (d, b);
+  a = block_to_arena (b);
+  a->free_cnt--;
+  return b;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) 
+{
+  void *p;
+  size_t size;
+
+  /* Calculate block size and make sure it fits in size_t. */
+  if (b != 0 && a > SIZE_MAX / b)
+    return NULL;
+  size = a * b;
+
+  /* Allocate and zero memory. */
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+
+  return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+block_size (void *block) 
+{
+  struct block *b = block;
+  struct arena *a = block_to_arena (b);
+  struct desc *d = a->desc;
+
+  return d != NULL ? d->block_size : PAGE_SIZE * a->free_cnt - sizeof *a;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size) 
+{
+  if (new_size == 0) 
+    {
+      free (old_block);
+      return NULL;
+    }
+  else if (old_block != NULL && new_size <= block_size (old_block))
+    {
+      /* Still fits. */
+      return old_block;
+    }
+  else 
+    {
+      void *new_block = malloc (new_size);
+      if (old_block != NULL && new_block != NULL)
+        {
+          memcpy (new_block, old_block, block_size (old_block));
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) 
+{
+  if (p != NULL)
+    {
+      struct block *b = p;
+      struct arena *a = block_to_arena (b);
+      struct desc *d = a->desc;
+      
+      if (d != NULL) 
+        {
+          /* It's a normal block.  We handle it here. */
+
+#ifndef NDEBUG
+          /* Clear the block to help detect use-after-free bugs. */
+          memset (b, 0xcc, d->block_size);
+#endif
+  
+          /* Add block to free list. */
+          push_block (d, b);
+
+          /* If the arena is now entirely unused, free it. */
+          if (++a->free_cnt >= d->blocks_per_arena) 
+            {
+              size_t i;
+
+              ASSERT (a->free_cnt == d->blocks_per_arena);
+              for (i = 0; i < d->blocks_per_arena; i++) 
+                remove_block (d, arena_to_block (a, i));
+              put_pages (a, 1);
+            }
+        }
+      else
+        {
+          /* It's a big block.  Free its pages. */
+          put_pages (a, a->free_cnt);
+        }
+    }
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena (struct block *b)
+{
+  struct arena *a = (struct arena *) ((uintptr_t) b & ~(PAGE_SIZE - 1));
+
+  /* Check that the arena is valid. */
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+
+  /* Check that the block is properly aligned for the arena. */
+  ASSERT (a->desc == NULL
+          || ((uintptr_t) b % PAGE_SIZE - sizeof *a)
+             % a->desc->block_size == 0);
+  ASSERT (a->desc != NULL || (uintptr_t) b % PAGE_SIZE == sizeof *a);
+
+  return a;
+}
+
+/* Returns the (IDX - 1)'th block within arena A. */
+static struct block *
+arena_to_block (struct arena *a, size_t idx) 
+{
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+  ASSERT (idx < a->desc->blocks_per_arena);
+  return (struct block *) ((uint8_t *) a
+                           + sizeof *a
+                           + idx * a->desc->block_size);
+}
+
+/* Returns the address just past run R. */
+static uint8_t *
+run_end (struct run *r) 
+{
+  return (uint8_t *) r + r->page_cnt * PAGE_SIZE;
+}
+
+/* Obtains PAGE_CNT contiguous pages, from the first free run big
+   enough or else by growing the heap.  Returns a null pointer if
+   the kernel refuses to grow the heap. */
+static void *
+get_pages (size_t page_cnt) 
+{
+  struct run **rp, *r;
+  uint8_t *brk;
+  size_t pad;
+
+  for (rp = &free_runs; (r = *rp) != NULL; rp = &r->next)
+    if (r->page_cnt >= page_cnt) 
+      {
+        /* Take the pages from the end of the run, so that the
+           rest of it stays where it is in the list. */
+        r->page_cnt -= page_cnt;
+        if (r->page_cnt == 0) 
+          {
+            *rp = r->next;
+            return r;
+          }
+        return run_end (r);
+      }
+
+  /* Grow the heap, first padding the break to a page boundary in
+     case the program has moved it itself. */
+  brk = sbrk (0);
+  if (brk == (void *) -1)
+    return NULL;
+  pad = ROUND_UP ((uintptr_t) brk, PAGE_SIZE) - (uintptr_t) brk;
+  if (page_cnt > (SIZE_MAX - pad) / PAGE_SIZE)
+    return NULL;
+  brk = sbrk (pad + page_cnt * PAGE_SIZE);
+  if (brk == (void *) -1)
+    return NULL;
+  return brk + pad;
+}
+
+/* Returns the PAGE_CNT pages starting at P to the free runs,
+   coalescing them with adjacent runs, and gives the top run
+   back to the kernel once it is large. */
+static void
+put_pages (void *p, size_t page_cnt) 
+{
+  struct run *prev = NULL, *next, *r = p;
+
+  /* Find the runs below and above P. */
+  for (next = free_runs; next != NULL && (void *) next < p; next = next->next)
+    prev = next;
+
+  r->page_cnt = page_cnt;
+  r->next = next;
+  if (next != NULL && run_end (r) == (uint8_t *) next) 
+    {
+      r->page_cnt += next->page_cnt;
+      r->next = next->next;
+    }
+  if (prev != NULL && run_end (prev) == (uint8_t *) r) 
+    {
+      prev->page_cnt += r->page_cnt;
+      prev->next = r->next;
+      r = prev;
+    }
+  else if (prev != NULL)
+    prev->next = r;
+  else
+    free_runs = r;
+
+  /* R is the last run; release it if it ends at the break. */
+  if (r->next == NULL && r->page_cnt >= TRIM_PAGES
+      && run_end (r) == (uint8_t *) sbrk (0)) 
+    {
+      if (prev == r) 
+        {
+          /* Find the run before R again. */
+          for (prev = NULL, next = free_runs; next != r; next = next->next)
+            prev = next;
+        }
+      if (sbrk (-(intptr_t) (r->page_cnt * PAGE_SIZE)) != (void *) -1) 
+        {
+          if (prev != NULL)
+            prev->next = NULL;
+          else
+            free_runs = NULL;
+        }
+    }
+}
@@ -4,4 +4,13 @@
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
 
+/* Buffering modes for hsetvbuf(). */
+#define _IONBF 0        /* Write each call through immediately. */
+#define _IOLBF 1        /* Write out at each new-line. */
+#define _IOFBF 2        /* Write out only when the buffer fills. */
+
+int hsetvbuf (int handle, int mode);
+int hflush (int handle);
+void hflush_all (void);
+
 #endif /* lib/user/stdio.h */
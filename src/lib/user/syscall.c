@@ -1,4 +1,5 @@
 #include <syscall.h>
+#include <stdio.h>
 #include "../syscall-nr.h"
 
 /* Invokes syscall NUMBER, passing no arguments, and returns the
@@ -61,9 +62,29 @@
           retval;                                               \
         })
 
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "    \
+             "pushl %[arg0]; "                                  \
+             "pushl %[number]; int $0x30; addl $20, %%esp"      \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "g" (ARG0),                             \
+                 [arg1] "g" (ARG1),                             \
+                 [arg2] "g" (ARG2),                             \
+                 [arg3] "g" (ARG3)                              \
+               : "memory");                                     \
+          retval;                                               \
+        })
+
 void
 halt (void) 
 {
+  hflush_all ();
   syscall0 (SYS_HALT);
   NOT_REACHED ();
 }
@@ -71,6 +92,7 @@ halt (void)
 void
 exit (int status)
 {
+  hflush_all ();
   syscall1 (SYS_EXIT, status);
   NOT_REACHED ();
 }
@@ -78,6 +100,7 @@ exit (int status)
 pid_t
 exec (const char *file)
 {
+  hflush_all ();
   return (pid_t) syscall1 (SYS_EXEC, file);
 }
 
@@ -114,6 +137,9 @@ filesize (int fd)
 int
 read (int fd, void *buffer, unsigned size)
 {
+  /* Show any prompt before waiting for the keyboard. */
+  if (fd == STDIN_FILENO)
+    hflush (STDOUT_FILENO);
   return syscall3 (SYS_READ, fd, buffer, size);
 }
 
@@ -138,6 +164,7 @@ tell (int fd)
 void
 close (int fd)
 {
+  hsetvbuf (fd, _IONBF);
   syscall1 (SYS_CLOSE, fd);
 }
 
@@ -182,3 +209,60 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+pid_t
+fork (void)
+{
+  /* Otherwise the child would write the same output again. */
+  hflush_all ();
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int
+copy_file_range (int fd_in, int fd_out, unsigned length)
+{
+  return syscall3 (SYS_COPY_FILE_RANGE, fd_in, fd_out, length);
+}
+
+int
+dup (int fd)
+{
+  return syscall1 (SYS_DUP, fd);
+}
+
+int
+dup2 (int oldfd, int newfd)
+{
+  hflush (newfd);
+  return syscall2 (SYS_DUP2, oldfd, newfd);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
@@ -18,10 +18,16 @@
 /* Maximum number of elements in an array that we will test. */
 #define MAX_CNT 4096
 
+/* Modulus used to create runs of equal keys for sort_stable(). */
+#define MOD 4
+
 static void shuffle (int[], size_t);
 static int compare_ints (const void *, const void *);
+static int compare_ints_aux (const void *, const void *, void *);
+static int compare_mod (const void *, const void *, void *);
 static void verify_order (const int[], size_t);
 static void verify_bsearch (const int[], size_t);
+static void verify_stable (const int[], size_t);
 
 /* Test sorting and searching implementations. */
 void
@@ -49,6 +55,16 @@ test (void)
           qsort (values, cnt, sizeof *values, compare_ints);
           verify_order (values, cnt);
           verify_bsearch (values, cnt);
+
+          /* Stably sort the sorted VALUES by their residue mod
+             MOD, which must keep each residue class in order. */
+          sort_stable (values, cnt, sizeof *values, compare_mod, NULL);
+          verify_stable (values, cnt);
+
+          shuffle (values, cnt);
+          sort_stable (values, cnt, sizeof *values, compare_mod, NULL);
+          sort_stable (values, cnt, sizeof *values, compare_ints_aux, NULL);
+          verify_order (values, cnt);
         }
     }
   
@@ -83,6 +99,36 @@ compare_ints (const void *a_, const void *b_)
   return *a < *b ? -1 : *a > *b;
 }
 
+/* compare_ints() with the signature taken by sort(). */
+static int
+compare_ints_aux (const void *a, const void *b, void *aux UNUSED) 
+{
+  return compare_ints (a, b);
+}
+
+/* Compares the ints at A and B by their residue mod MOD. */
+static int
+compare_mod (const void *a_, const void *b_, void *aux UNUSED) 
+{
+  int a = *(const int *) a_ % MOD;
+  int b = *(const int *) b_ % MOD;
+
+  return a < b ? -1 : a > b;
+}
+
+/* Verifies that ARRAY contains the CNT ints 0...CNT-1 ordered by
+   residue mod MOD, and by value within each residue. */
+static void
+verify_stable (const int *array, size_t cnt) 
+{
+  size_t i;
+
+  for (i = 1; i < cnt; i++) 
+    ASSERT (array[i - 1] % MOD < array[i] % MOD
+            || (array[i - 1] % MOD == array[i] % MOD
+                && array[i - 1] < array[i]));
+}
+
 /* Verifies that ARRAY contains the CNT ints 0...CNT-1. */
 static void
 verify_order (const int *array, size_t cnt) 
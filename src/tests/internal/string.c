@@ -0,0 +1,232 @@
+/* Test program and microbenchmark for the block functions in
+   lib/string.c.
+
+   Checks memcpy(), memmove(), memset(), memcmp() and strlen()
+   against simple byte-at-a-time versions for every combination
+   of small alignments and lengths, then times both versions on
+   page-sized blocks and prints cycles per call.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+
+/* Size of the test buffers. */
+#define BUF_SIZE 8192
+
+/* Largest alignment offset and length tried by the checks. */
+#define MAX_OFS 8
+#define MAX_LEN 96
+
+/* Bytes per call and number of calls timed by the benchmark. */
+#define BENCH_SIZE 4096
+#define BENCH_CNT 256
+
+static uint8_t buf_a[BUF_SIZE], buf_b[BUF_SIZE], buf_c[BUF_SIZE];
+
+static void check_copies (void);
+static void check_compares (void);
+static void bench (void);
+
+/* Test the string implementation. */
+void
+test (void)
+{
+  random_bytes (buf_a, sizeof buf_a);
+  check_copies ();
+  check_compares ();
+  bench ();
+  printf ("string: PASS\n");
+}
+
+/* Reference byte-at-a-time versions. */
+static void
+byte_copy (uint8_t *dst, const uint8_t *src, size_t size)
+{
+  while (size-- > 0)
+    *dst++ = *src++;
+}
+
+static void
+byte_move (uint8_t *dst, const uint8_t *src, size_t size)
+{
+  if (dst < src)
+    byte_copy (dst, src, size);
+  else
+    while (size-- > 0)
+      dst[size] = src[size];
+}
+
+static void
+byte_set (uint8_t *dst, int value, size_t size)
+{
+  while (size-- > 0)
+    *dst++ = value;
+}
+
+static size_t
+byte_strlen (const char *s)
+{
+  const char *p;
+
+  for (p = s; *p != '\0'; p++)
+    continue;
+  return p - s;
+}
+
+/* Checks memcpy(), memmove() and memset() at each alignment and
+   length, including that bytes outside the block are
+   untouched. */
+static void
+check_copies (void)
+{
+  size_t dst_ofs, src_ofs, len;
+
+  for (dst_ofs = 0; dst_ofs < MAX_OFS; dst_ofs++)
+    for (src_ofs = 0; src_ofs < MAX_OFS; src_ofs++)
+      for (len = 0; len < MAX_LEN; len++)
+        {
+          uint8_t *a = buf_a + MAX_OFS;
+
+          memcpy (buf_b, buf_a, BUF_SIZE);
+          memcpy (buf_c, buf_a, BUF_SIZE);
+          ASSERT (memcpy (buf_b + dst_ofs, a + src_ofs, len)
+                  == buf_b + dst_ofs);
+          byte_copy (buf_c + dst_ofs, a + src_ofs, len);
+          ASSERT (!memcmp (buf_b, buf_c, BUF_SIZE));
+
+          /* Overlapping moves in both directions. */
+          ASSERT (memmove (buf_b + dst_ofs, buf_b + src_ofs, len)
+                  == buf_b + dst_ofs);
+          byte_move (buf_c + dst_ofs, buf_c + src_ofs, len);
+          ASSERT (!memcmp (buf_b, buf_c, BUF_SIZE));
+
+          ASSERT (memset (buf_b + dst_ofs, src_ofs * 37, len)
+                  == buf_b + dst_ofs);
+          byte_set (buf_c + dst_ofs, src_ofs * 37, len);
+          ASSERT (!memcmp (buf_b, buf_c, BUF_SIZE));
+        }
+}
+
+/* Checks memcmp() and strlen() at each alignment and length. */
+static void
+check_compares (void)
+{
+  size_t ofs, len, i;
+
+  for (ofs = 0; ofs < MAX_OFS; ofs++)
+    for (len = 0; len < MAX_LEN; len++)
+      {
+        uint8_t *b = buf_b + ofs;
+
+        memcpy (buf_b, buf_a, BUF_SIZE);
+        ASSERT (memcmp (b, buf_a + ofs, len) == 0);
+        for (i = 0; i < len; i++)
+          {
+            b[i]++;
+            ASSERT (memcmp (b, buf_a + ofs, len)
+                    == (b[i] > buf_a[ofs + i] ? 1 : -1));
+            b[i]--;
+          }
+
+        for (i = 0; i < len; i++)
+          b[i] = b[i] != 0 ? b[i] : 1;
+        b[len] = '\0';
+        ASSERT (strlen ((char *) b) == len);
+        ASSERT (byte_strlen ((char *) b) == len);
+      }
+}
+
+/* Returns the processor's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Prints the average cycles per call of the library and the
+   reference versions of NAME, timed by running each BENCH_CNT
+   times between T0, T1 and T2. */
+static void
+report (const char *name, uint64_t t0, uint64_t t1, uint64_t t2)
+{
+  uint64_t fast = (t1 - t0) / BENCH_CNT;
+  uint64_t slow = (t2 - t1) / BENCH_CNT;
+
+  printf ("%-8s %6d bytes: %8"PRIu64" cycles, byte loop %8"PRIu64
+          " cycles (%"PRIu64".%"PRIu64"x)\n",
+          name, BENCH_SIZE, fast, slow,
+          slow / (fast ? fast : 1), slow * 10 / (fast ? fast : 1) % 10);
+}
+
+/* Times page-sized operations against the byte loops. */
+static void
+bench (void)
+{
+  uint64_t t0, t1, t2;
+  volatile size_t sink = 0;
+  int i;
+
+  t0 = rdtsc ();
+  for (i = 0; i < BENCH_CNT; i++)
+    memcpy (buf_b, buf_a, BENCH_SIZE);
+  t1 = rdtsc ();
+  for (i = 0; i < BENCH_CNT; i++)
+    byte_copy (buf_b, buf_a, BENCH_SIZE);
+  t2 = rdtsc ();
+  report ("memcpy", t0, t1, t2);
+
+  t0 = rdtsc ();
+  for (i = 0; i < BENCH_CNT; i++)
+    memmove (buf_b + 1, buf_b, BENCH_SIZE);
+  t1 = rdtsc ();
+  for (i = 0; i < BENCH_CNT; i++)
+    byte_move (buf_b + 1, buf_b, BENCH_SIZE);
+  t2 = rdtsc ();
+  report ("memmove", t0, t1, t2);
+
+  t0 = rdtsc ();
+  for (i = 0; i < BENCH_CNT; i++)
+    memset (buf_b, i, BENCH_SIZE);
+  t1 = rdtsc ();
+  for (i = 0; i < BENCH_CNT; i++)
+    byte_set (buf_b, i, BENCH_SIZE);
+  t2 = rdtsc ();
+  report ("memset", t0, t1, t2);
+
+  memcpy (buf_c, buf_b, BENCH_SIZE);
+  t0 = rdtsc ();
+  for (i = 0; i < BENCH_CNT; i++)
+    sink += memcmp (buf_b, buf_c, BENCH_SIZE);
+  t1 = rdtsc ();
+  for (i = 0; i < BENCH_CNT; i++)
+    {
+      size_t j;
+      for (j = 0; j < BENCH_SIZE && buf_b[j] == buf_c[j]; j++)
+        continue;
+      sink += j;
+    }
+  t2 = rdtsc ();
+  report ("memcmp", t0, t1, t2);
+
+  memset (buf_b, 'x', BENCH_SIZE);
+  buf_b[BENCH_SIZE] = '\0';
+  t0 = rdtsc ();
+  for (i = 0; i < BENCH_CNT; i++)
+    sink += strlen ((char *) buf_b);
+  t1 = rdtsc ();
+  for (i = 0; i < BENCH_CNT; i++)
+    sink += byte_strlen ((char *) buf_b);
+  t2 = rdtsc ();
+  report ("strlen", t0, t1, t2);
+}
@@ -0,0 +1,72 @@
+/* Tests that readers share a reader-writer lock, that a reader
+   waits behind a waiting writer of the same priority instead of
+   starving it, and that a reader of higher priority than the
+   waiting writer still gets in. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+struct rwlock_writer_pref
+  {
+    struct rwlock rw;
+    struct semaphore done;
+  };
+
+static thread_func reader_thread;
+static thread_func writer_thread;
+
+void
+test_rwlock_writer_pref (void)
+{
+  struct rwlock_writer_pref t;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  rwlock_init (&t.rw);
+  sema_init (&t.done, 0);
+
+  /* Each thread below has a higher priority than this one, so it
+     runs as soon as it is created, until it finishes or waits
+     for the lock. */
+  rwlock_acquire_read (&t.rw);
+  msg ("Main thread holds the lock to read.");
+  thread_create ("reader 1", PRI_DEFAULT + 1, reader_thread, &t);
+  thread_create ("writer", PRI_DEFAULT + 1, writer_thread, &t);
+  thread_create ("reader 2", PRI_DEFAULT + 1, reader_thread, &t);
+  thread_create ("reader 3", PRI_DEFAULT + 2, reader_thread, &t);
+  msg ("Main thread releasing the lock.");
+  rwlock_release_read (&t.rw);
+
+  for (i = 0; i < 4; i++)
+    sema_down (&t.done);
+  msg ("Main thread finished.");
+}
+
+static void
+reader_thread (void *t_)
+{
+  struct rwlock_writer_pref *t = t_;
+
+  msg ("Thread %s waiting to read.", thread_name ());
+  rwlock_acquire_read (&t->rw);
+  msg ("Thread %s reading.", thread_name ());
+  rwlock_release_read (&t->rw);
+  sema_up (&t->done);
+}
+
+static void
+writer_thread (void *t_)
+{
+  struct rwlock_writer_pref *t = t_;
+
+  msg ("Thread %s waiting to write.", thread_name ());
+  rwlock_acquire_write (&t->rw);
+  msg ("Thread %s writing.", thread_name ());
+  rwlock_release_write (&t->rw);
+  sema_up (&t->done);
+}
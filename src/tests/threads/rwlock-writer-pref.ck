@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-writer-pref) begin
+(rwlock-writer-pref) Main thread holds the lock to read.
+(rwlock-writer-pref) Thread reader 1 waiting to read.
+(rwlock-writer-pref) Thread reader 1 reading.
+(rwlock-writer-pref) Thread writer waiting to write.
+(rwlock-writer-pref) Thread reader 2 waiting to read.
+(rwlock-writer-pref) Thread reader 3 waiting to read.
+(rwlock-writer-pref) Thread reader 3 reading.
+(rwlock-writer-pref) Main thread releasing the lock.
+(rwlock-writer-pref) Thread writer writing.
+(rwlock-writer-pref) Thread reader 2 reading.
+(rwlock-writer-pref) Main thread finished.
+(rwlock-writer-pref) end
+EOF
+pass;
@@ -0,0 +1,88 @@
+/* Tests that a sequence lock reader retries a read that a write
+   overlapped, whether the write ran between the start and end of
+   the read or was still in progress when the read started, and
+   that the read it accepts is never half-written. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+struct seqlock_retry
+  {
+    struct seqlock sl;
+    struct semaphore mid_write;  /* Writer waits here mid-write. */
+    int a, b;                    /* Always equal outside a write. */
+  };
+
+static thread_func writer_thread;
+static void read_pair (struct seqlock_retry *);
+
+void
+test_seqlock_retry (void)
+{
+  struct seqlock_retry t;
+  unsigned seq;
+  int a;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  seqlock_init (&t.sl);
+  sema_init (&t.mid_write, 1);
+  t.a = t.b = 0;
+
+  /* The writer has a higher priority than this thread, so
+     creating it runs a whole write in the middle of this read. */
+  seq = seqlock_read_begin (&t.sl);
+  a = *(volatile int *) &t.a;
+  thread_create ("writer 1", PRI_DEFAULT + 1, writer_thread, &t);
+  if (!seqlock_read_retry (&t.sl, seq))
+    fail ("read of a = %d not retried after a write", a);
+  msg ("Read overlapping a write retried.");
+  read_pair (&t);
+
+  /* This writer stops half way through its write, so the read
+     starts while the write is in progress. */
+  sema_init (&t.mid_write, 0);
+  thread_create ("writer 2", PRI_DEFAULT + 1, writer_thread, &t);
+  seq = seqlock_read_begin (&t.sl);
+  if (!seqlock_read_retry (&t.sl, seq))
+    fail ("read during a write not retried");
+  msg ("Read during a write retried.");
+  sema_up (&t.mid_write);
+  read_pair (&t);
+}
+
+/* Reads T's pair under its sequence lock and checks that the
+   halves match. */
+static void
+read_pair (struct seqlock_retry *t)
+{
+  unsigned seq;
+  int a, b;
+
+  do
+    {
+      seq = seqlock_read_begin (&t->sl);
+      a = *(volatile int *) &t->a;
+      b = *(volatile int *) &t->b;
+    }
+  while (seqlock_read_retry (&t->sl, seq));
+  if (a != b)
+    fail ("read half-written pair (%d, %d)", a, b);
+  msg ("Read pair (%d, %d).", a, b);
+}
+
+static void
+writer_thread (void *t_)
+{
+  struct seqlock_retry *t = t_;
+
+  seqlock_write_begin (&t->sl);
+  t->a++;
+  sema_down (&t->mid_write);
+  t->b++;
+  seqlock_write_end (&t->sl);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(seqlock-retry) begin
+(seqlock-retry) Read overlapping a write retried.
+(seqlock-retry) Read pair (1, 1).
+(seqlock-retry) Read during a write retried.
+(seqlock-retry) Read pair (2, 2).
+(seqlock-retry) end
+EOF
+pass;
@@ -0,0 +1,24 @@
+/* Copies sample.txt into a new file with copy_file_range() and
+   checks that the copy matches and both positions advanced. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int size = sizeof sample - 1;
+  int in_fd, out_fd;
+
+  CHECK ((in_fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (create ("copy.txt", size), "create \"copy.txt\"");
+  CHECK ((out_fd = open ("copy.txt")) > 1, "open \"copy.txt\"");
+  CHECK (copy_file_range (in_fd, out_fd, size) == size,
+         "copy \"sample.txt\" to \"copy.txt\"");
+  CHECK (tell (in_fd) == (unsigned) size && tell (out_fd) == (unsigned) size,
+         "tell after copy");
+  CHECK (copy_file_range (in_fd, out_fd, 1) == 0, "copy at end of file");
+  check_file ("copy.txt", sample, size);
+}
@@ -0,0 +1,27 @@
+/* Duplicates a file descriptor with dup() and dup2(), checks
+   that the copies share the file position, and that a closed
+   descriptor is the next one handed out. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[16];
+  int fd, fd2, fd3;
+
+  CHECK ((fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((fd2 = dup (fd)) > 1 && fd2 != fd, "dup");
+  CHECK (read (fd, buf, 5) == 5, "read 5 bytes from original");
+  CHECK (tell (fd2) == 5, "duplicate shares position");
+  CHECK (dup2 (fd, 100) == 100, "dup2 onto 100");
+  CHECK (read (100, buf, 5) == 5 && tell (fd) == 10, "read through 100");
+  msg ("close original");
+  close (fd);
+  CHECK (tell (fd2) == 10, "duplicate still open");
+  CHECK ((fd3 = open ("sample.txt")) == fd, "closed fd reused");
+  CHECK (dup2 (fd3, fd2) == fd2 && tell (fd2) == 0, "dup2 replaces open fd");
+  CHECK (dup (1) == -1, "dup console fails");
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dup) begin
+(dup) open "sample.txt"
+(dup) dup
+(dup) read 5 bytes from original
+(dup) duplicate shares position
+(dup) dup2 onto 100
+(dup) read through 100
+(dup) close original
+(dup) duplicate still open
+(dup) closed fd reused
+(dup) dup2 replaces open fd
+(dup) dup console fails
+(dup) end
+dup: exit(0)
+EOF
+pass;
@@ -0,0 +1,17 @@
+/* Passes read a buffer that starts in user memory but whose
+   size makes it wrap around the end of the address space.
+   The process must be terminated with -1 exit code. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int handle;
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  read (handle, (char *) 0x08048000, 0xf8000000);
+  fail ("should not have survived read()");
+}
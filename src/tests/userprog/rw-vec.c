@@ -0,0 +1,46 @@
+/* Writes a file with writev() and reads it back with readv()
+   and pread(), then overwrites a byte with pwrite().  The
+   positioned calls must leave the file position alone. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  size_t size = sizeof sample - 1;
+  size_t half = size / 2;
+  char buf[sizeof sample];
+  struct iovec iov[2];
+  int handle;
+
+  CHECK (create ("test.txt", size), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  iov[0].iov_base = (void *) sample;
+  iov[0].iov_len = half;
+  iov[1].iov_base = (void *) (sample + half);
+  iov[1].iov_len = size - half;
+  CHECK (writev (handle, iov, 2) == (int) size, "writev \"test.txt\"");
+  CHECK (tell (handle) == size, "tell \"test.txt\" after writev");
+
+  CHECK (pread (handle, buf, size, 0) == (int) size, "pread \"test.txt\"");
+  compare_bytes (buf, sample, size, 0, "test.txt");
+  CHECK (tell (handle) == size, "tell \"test.txt\" after pread");
+
+  seek (handle, 0);
+  memset (buf, 0, sizeof buf);
+  iov[0].iov_base = buf;
+  iov[1].iov_base = buf + half;
+  CHECK (readv (handle, iov, 2) == (int) size, "readv \"test.txt\"");
+  compare_bytes (buf, sample, size, 0, "test.txt");
+
+  CHECK (pwrite (handle, "#", 1, 0) == 1, "pwrite \"test.txt\"");
+  CHECK (tell (handle) == size, "tell \"test.txt\" after pwrite");
+  CHECK (pread (handle, buf, 1, 0) == 1, "pread \"test.txt\" again");
+  if (buf[0] != '#')
+    fail ("pread() returned '%c' instead of '#'", buf[0]);
+}
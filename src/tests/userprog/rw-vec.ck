@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rw-vec) begin
+(rw-vec) create "test.txt"
+(rw-vec) open "test.txt"
+(rw-vec) writev "test.txt"
+(rw-vec) tell "test.txt" after writev
+(rw-vec) pread "test.txt"
+(rw-vec) tell "test.txt" after pread
+(rw-vec) readv "test.txt"
+(rw-vec) pwrite "test.txt"
+(rw-vec) tell "test.txt" after pwrite
+(rw-vec) pread "test.txt" again
+(rw-vec) end
+rw-vec: exit(0)
+EOF
+pass;
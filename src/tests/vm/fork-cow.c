@@ -0,0 +1,46 @@
+/* Forks a child that writes to data pages it shares
+   copy-on-write with its parent, and verifies that each
+   process sees only its own writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (4 * 4096)
+static char buf[SIZE];
+
+/* Fails unless every byte of BUF equals C. */
+static void
+check_buf (char c, const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != c)
+      fail ("%s: byte %zu is %d, expected %d", who, i, buf[i], c);
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+
+  memset (buf, 'p', sizeof buf);
+
+  quiet = true;
+  child = fork ();
+  if (child == 0)
+    {
+      check_buf ('p', "child before write");
+      memset (buf, 'c', sizeof buf);
+      check_buf ('c', "child after write");
+      exit (81);
+    }
+  CHECK (child != -1, "fork");
+  quiet = false;
+
+  CHECK (wait (child) == 81, "wait for child");
+  check_buf ('p', "parent");
+  msg ("parent's copy unchanged");
+}
@@ -0,0 +1,89 @@
+/* Grows and shrinks the heap with sbrk(), then builds and frees
+   a mix of small and page-sized blocks with malloc(), checking
+   that no two blocks overlap and that freeing everything gives
+   the whole heap back to the kernel. */
+
+#include <malloc.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_CNT 256
+
+static char *blocks[BLOCK_CNT];
+static size_t sizes[BLOCK_CNT];
+
+/* Returns the size of the I'th block: mostly small, with every
+   16th block spanning several pages. */
+static size_t
+block_size (int i)
+{
+  return i % 16 == 15 ? 3 * 4096 + i : 1 + (i * 37) % 900;
+}
+
+/* Fails unless block I still holds its fill pattern. */
+static void
+check_block (int i)
+{
+  size_t j;
+
+  for (j = 0; j < sizes[i]; j++)
+    if (blocks[i][j] != (char) i)
+      fail ("block %d byte %zu changed", i, j);
+}
+
+void
+test_main (void)
+{
+  char *start, *p;
+  int i;
+
+  start = sbrk (0);
+  CHECK (start != (void *) -1, "sbrk(0)");
+  CHECK (sbrk (8192) == start, "grow heap by two pages");
+  memset (start, 'x', 8192);
+  CHECK (sbrk (-4096) == start + 8192, "shrink heap by one page");
+  CHECK (start[4095] == 'x', "first page kept");
+  CHECK (sbrk (-4096) == start + 4096, "shrink heap to empty");
+  CHECK (sbrk (-1) == (void *) -1, "shrinking below heap start fails");
+
+  quiet = true;
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      sizes[i] = block_size (i);
+      blocks[i] = malloc (sizes[i]);
+      CHECK (blocks[i] != NULL, "malloc %zu bytes", sizes[i]);
+      memset (blocks[i], i, sizes[i]);
+    }
+  for (i = 0; i < BLOCK_CNT; i++)
+    check_block (i);
+
+  /* Free every other block and grow the rest. */
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    free (blocks[i]);
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    {
+      blocks[i] = realloc (blocks[i], sizes[i] * 2);
+      CHECK (blocks[i] != NULL, "realloc %zu bytes", sizes[i] * 2);
+      check_block (i);
+      memset (blocks[i] + sizes[i], i, sizes[i]);
+      sizes[i] *= 2;
+    }
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    check_block (i);
+
+  p = calloc (100, 100);
+  CHECK (p != NULL, "calloc");
+  for (i = 0; i < 100 * 100; i++)
+    if (p[i] != 0)
+      fail ("calloc byte %d is %d", i, p[i]);
+  free (p);
+
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    free (blocks[i]);
+  quiet = false;
+
+  msg ("all blocks intact");
+  CHECK (sbrk (0) == start, "heap returned to kernel");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-heap) begin
+(malloc-heap) sbrk(0)
+(malloc-heap) grow heap by two pages
+(malloc-heap) shrink heap by one page
+(malloc-heap) first page kept
+(malloc-heap) shrink heap to empty
+(malloc-heap) shrinking below heap start fails
+(malloc-heap) all blocks intact
+(malloc-heap) heap returned to kernel
+(malloc-heap) end
+malloc-heap: exit(0)
+EOF
+pass;
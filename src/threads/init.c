@@ -24,6 +24,7 @@
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -100,6 +101,7 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  trace_init ();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -176,21 +178,44 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      /* A 4 MB span that lies entirely in RAM and holds no kernel
+         text is mapped by a single large page, which saves a page
+         table and a TLB entry per 1,024 pages.  Kernel mappings
+         are the same in every page directory, so all of them are
+         global. */
+      if (pte_idx == 0 && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true) | PTE_G;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | PTE_G;
     }
 
+  /* Enable 4 MB pages before any PDE with PTE_PS set becomes
+     live.  See [IA32-v3a] 2.5 "Control Registers". */
+  asm volatile ("movl %%cr4, %%eax; orl %0, %%eax; movl %%eax, %%cr4"
+                : : "i" (CR4_PSE) : "eax");
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  /* Let the kernel's global TLB entries survive later CR3
+     loads. */
+  asm volatile ("movl %%cr4, %%eax; orl %0, %%eax; movl %%eax, %%cr4"
+                : : "i" (CR4_PGE) : "eax");
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -261,9 +286,23 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-lp"))
+        lock_profile = true;
+      else if (!strcmp (name, "-pf"))
+        timer_profile = value != NULL ? atoi (value) : 1;
+#ifdef TRACE
+      else if (!strcmp (name, "-tr"))
+        trace_pages = value != NULL ? atoi (value) : 32;
+#endif
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-fa"))
+        fault_around_max = atoi (value);
+      else if (!strcmp (name, "-sl"))
+        stack_limit = (size_t) atoi (value) * 1024;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -384,8 +423,19 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -lp                Profile lock contention, print it at shutdown.\n"
+          "  -pf[=N]            Sample the running PC N times per timer tick,\n"
+          "                     print the samples at shutdown.\n"
+#ifdef TRACE
+          "  -tr[=PAGES]        Trace kernel events into a PAGES-page buffer,\n"
+          "                     write it to scratch as `trace' at shutdown.\n"
+#endif
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -fa=COUNT          Fault in at most COUNT neighboring pages.\n"
+          "  -sl=KB             Let user stacks grow to at most KB kB.\n"
 #endif
           );
   shutdown_power_off ();
@@ -66,6 +66,18 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page, 0=page table (PDEs only). */
+#define PTE_G 0x100             /* 1=global, kept in TLB across CR3 loads. */
+
+/* CR4 bit that makes the CPU honor PTE_PS in PDEs.
+   See [IA32-v3a] 3.7.3 "Mixing 4-KByte and 4-MByte Pages". */
+#define CR4_PSE 0x00000010      /* Page Size Extensions. */
+
+/* CR4 bit that makes the CPU honor PTE_G.  Every page directory
+   maps the kernel identically, so kernel translations marked
+   global stay valid across a switch of page directory.  See
+   [IA32-v3a] 3.11 "Translation Lookaside Buffers (TLBs)". */
+#define CR4_PGE 0x00000080      /* Page Global Enable. */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -77,9 +89,32 @@ static inline uint32_t pde_create (uint32_t *pt) {
    PDE, which must "present", points to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!(pde & PTE_PS));
   return ptov (pde & PTE_ADDR);
 }
 
+/* Returns a PDE that maps the 4 MB page that starts at PAGE,
+   which must be 4 MB aligned in physical memory.
+   The page is readable, and writable if WRITABLE is true.
+   The page will be usable only by ring 0 code (the kernel). */
+static inline uint32_t pde_create_large (void *page, bool writable) {
+  ASSERT (vtop (page) % PTSPAN == 0);
+  return vtop (page) | PTE_PS | PTE_P | (writable ? PTE_W : 0);
+}
+
+/* Returns true if PDE is present and maps a 4 MB page rather
+   than pointing to a page table. */
+static inline bool pde_is_large (uint32_t pde) {
+  return (pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS);
+}
+
+/* Returns a pointer to the 4 MB page that large page directory
+   entry PDE points to. */
+static inline void *pde_get_large_page (uint32_t pde) {
+  ASSERT (pde_is_large (pde));
+  return ptov (pde & ~(uint32_t) (PTSPAN - 1));
+}
+
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
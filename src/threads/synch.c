@@ -27,10 +27,13 @@
 */
 
 #include "threads/synch.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -68,7 +71,8 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      list_insert_ordered (&sema->waiters, &thread_current ()->elem,
+                           cmp_priority, NULL);
       thread_block ();
     }
   sema->value--;
@@ -102,7 +106,9 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, yielding to it if it outranks the current
+   thread.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,9 +120,15 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      /* Donations may have reordered the waiters since they
+         were queued. */
+      list_sort (&sema->waiters, cmp_priority, NULL);
+      thread_unblock (list_entry (list_pop_front (&sema->waiters),
+                                  struct thread, elem));
+    }
   sema->value++;
+  test_max_priority ();
   intr_set_level (old_level);
 }
 
@@ -157,6 +169,84 @@ sema_test_helper (void *sema_)
     }
 }
 
+/* If true, locks record contention in a struct lock_prof.
+   Controlled by kernel command-line option "-lp". */
+bool lock_profile;
+
+/* Number of distinct lock_init() call sites that are profiled.
+   Locks from sites beyond this many go unprofiled. */
+#define LOCK_PROF_CNT 64
+
+/* Lock profiles, hashed by the caller of lock_init().  Locks come
+   and go (inodes, buffers on the stack) while their profiles live
+   on, so a profile covers every lock initialized at one site. */
+static struct lock_prof lock_profs[LOCK_PROF_CNT];
+
+/* Returns the profile for locks initialized at SITE, claiming a
+   free one if SITE is new, or a null pointer if none is left. */
+static struct lock_prof *
+lock_prof_get (void *site)
+{
+  size_t start = ((uintptr_t) site >> 2) % LOCK_PROF_CNT;
+  size_t i = start;
+  struct lock_prof *prof = NULL;
+  enum intr_level old_level = intr_disable ();
+
+  do
+    {
+      if (lock_profs[i].init_site == site || lock_profs[i].init_site == NULL)
+        {
+          prof = &lock_profs[i];
+          prof->init_site = site;
+          break;
+        }
+      i = (i + 1) % LOCK_PROF_CNT;
+    }
+  while (i != start);
+  intr_set_level (old_level);
+  return prof;
+}
+
+/* Records in PROF that an acquire waited WAIT ticks for a holder
+   that had acquired the lock at HOLDER_SITE.  SPUN is true if it
+   got the lock without blocking. */
+static void
+lock_prof_contended (struct lock_prof *prof, bool spun, int64_t wait,
+                     void *holder_site)
+{
+  prof->contended_cnt++;
+  if (spun)
+    prof->spin_cnt++;
+  prof->wait_ticks += wait;
+  if (wait >= prof->max_wait_ticks)
+    {
+      prof->max_wait_ticks = wait;
+      prof->max_holder_site = holder_site;
+    }
+}
+
+/* Prints lock contention statistics, one line per lock_init()
+   call site that saw contention.  Addresses can be turned into
+   source lines with the backtrace tool. */
+void
+lock_print_stats (void) 
+{
+  size_t i;
+
+  if (!lock_profile)
+    return;
+  printf ("Lock profile (init site: acquires, contended, spun, "
+          "wait ticks, max wait, holder site at max):\n");
+  for (i = 0; i < LOCK_PROF_CNT; i++)
+    {
+      struct lock_prof *p = &lock_profs[i];
+      if (p->init_site != NULL && p->contended_cnt > 0)
+        printf ("  %p: %u, %u, %u, %"PRId64", %"PRId64", %p\n",
+                p->init_site, p->acquire_cnt, p->contended_cnt, p->spin_cnt,
+                p->wait_ticks, p->max_wait_ticks, p->max_holder_site);
+    }
+}
+
 /* Initializes LOCK.  A lock can be held by at most a single
    thread at any given time.  Our locks are not "recursive", that
    is, it is an error for the thread currently holding a lock to
@@ -179,12 +269,39 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+  lock->site = NULL;
+  lock->prof = lock_profile ? lock_prof_get (__builtin_return_address (0))
+                            : NULL;
+}
+
+/* Returns true if yielding the CPU would let LOCK's holder run
+   and release it soon: the holder is ready to run and the
+   scheduler would pick it over the current thread.  On a single
+   CPU the holder is never running while we are, so this is the
+   only case in which waiting without blocking can pay off.  Must
+   be called with interrupts off. */
+static bool
+lock_holder_runnable (const struct lock *lock)
+{
+  struct thread *holder = lock->holder;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  return (holder != NULL && holder->status == THREAD_READY
+          && holder->priority >= thread_current ()->priority);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   Locks mostly guard short critical sections, so a contended
+   acquire first yields to the holder up to LOCK_SPIN_MAX times
+   while the holder is runnable, and only then blocks.
+
+   While it blocks, the current thread donates its priority to
+   the holder of LOCK, and on through the holder of any lock
+   that thread is waiting for, up to DONATION_DEPTH_MAX deep.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +309,52 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  old_level = intr_disable ();
+  if (!sema_try_down (&lock->semaphore))
+    {
+      void *holder_site = lock->site;
+      int64_t start = lock->prof != NULL ? timer_ticks () : 0;
+      bool spun = false;
+      int spin;
+
+      TRACE_BEGIN (TRACE_LOCK_WAIT, lock,
+                   lock->holder != NULL ? lock->holder->tid : TID_ERROR);
+      for (spin = 0; !spun && spin < LOCK_SPIN_MAX
+                     && lock_holder_runnable (lock); spin++)
+        {
+          thread_yield ();
+          spun = sema_try_down (&lock->semaphore);
+        }
+
+      if (!spun)
+        {
+          if (!thread_mlfqs && lock->holder != NULL)
+            {
+              cur->wait_on_lock = lock;
+              list_push_back (&lock->holder->donations, &cur->donation_elem);
+              donate_priority ();
+            }
+          sema_down (&lock->semaphore);
+          cur->wait_on_lock = NULL;
+        }
+      TRACE_END (TRACE_LOCK_WAIT, lock, spun);
+
+      if (lock->prof != NULL)
+        lock_prof_contended (lock->prof, spun, timer_ticks () - start,
+                             holder_site);
+    }
+  lock->holder = cur;
+  lock->site = __builtin_return_address (0);
+  if (lock->prof != NULL)
+    lock->prof->acquire_cnt++;
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -216,11 +373,17 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      lock->site = __builtin_return_address (0);
+      if (lock->prof != NULL)
+        lock->prof->acquire_cnt++;
+    }
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Gives back any priority donated by threads waiting for LOCK.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +391,20 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  if (!thread_mlfqs)
+    {
+      remove_with_lock (lock);
+      refresh_priority ();
+    }
   lock->holder = NULL;
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -251,8 +423,19 @@ struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+/* Returns true if the thread waiting in semaphore_elem A has a
+   higher priority than the one waiting in B. */
+static bool
+cmp_sem_priority (const struct list_elem *a, const struct list_elem *b,
+                  void *aux UNUSED)
+{
+  return list_entry (a, struct semaphore_elem, elem)->thread->priority
+         > list_entry (b, struct semaphore_elem, elem)->thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -295,14 +478,16 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
-  list_push_back (&cond->waiters, &waiter.elem);
+  waiter.thread = thread_current ();
+  list_insert_ordered (&cond->waiters, &waiter.elem, cmp_sem_priority, NULL);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest-priority one to wake up from
+   its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -317,8 +502,11 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      list_sort (&cond->waiters, cmp_sem_priority, NULL);
+      sema_up (&list_entry (list_pop_front (&cond->waiters),
+                            struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -336,3 +524,232 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* One thread waiting for a reader-writer lock. */
+struct rwlock_waiter 
+  {
+    struct list_elem elem;              /* List element. */
+    struct thread *thread;              /* The waiting thread. */
+    bool write;                         /* Waiting to write? */
+    struct semaphore semaphore;         /* Upped once it holds the lock. */
+  };
+
+/* Initializes reader-writer lock RW.  Any number of threads may
+   hold RW to read at once, or a single thread may hold it to
+   write.
+
+   Waiters are kept in priority order, with a writer ahead of
+   readers of equal priority.  A new reader only skips the queue
+   when no waiting writer has a priority as high as its own, so
+   that a stream of readers cannot starve writers but a
+   high-priority reader is not held up by a low-priority
+   writer. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  list_init (&rw->waiters);
+  rw->readers = 0;
+  rw->writer = NULL;
+}
+
+/* Returns true if waiter A should be woken before waiter B. */
+static bool
+rwlock_waiter_less (const struct list_elem *a_, const struct list_elem *b_,
+                    void *aux UNUSED)
+{
+  const struct rwlock_waiter *a = list_entry (a_, struct rwlock_waiter, elem);
+  const struct rwlock_waiter *b = list_entry (b_, struct rwlock_waiter, elem);
+
+  if (a->thread->priority != b->thread->priority)
+    return a->thread->priority > b->thread->priority;
+  return a->write && !b->write;
+}
+
+/* Queues the current thread on RW, whose lock must be held, and
+   sleeps until a releaser hands RW over to it. */
+static void
+rwlock_wait (struct rwlock *rw, bool write)
+{
+  struct rwlock_waiter waiter;
+
+  waiter.thread = thread_current ();
+  waiter.write = write;
+  sema_init (&waiter.semaphore, 0);
+  list_insert_ordered (&rw->waiters, &waiter.elem, rwlock_waiter_less, NULL);
+  lock_release (&rw->lock);
+  sema_down (&waiter.semaphore);
+}
+
+/* Hands RW, whose lock must be held and which must not be held
+   to write, to the waiters at the front of the queue: either one
+   writer, if there are no readers left, or every reader up to the
+   first waiting writer. */
+static void
+rwlock_wake (struct rwlock *rw)
+{
+  while (!list_empty (&rw->waiters))
+    {
+      struct rwlock_waiter *w = list_entry (list_front (&rw->waiters),
+                                            struct rwlock_waiter, elem);
+      if (w->write)
+        {
+          if (rw->readers == 0)
+            {
+              list_pop_front (&rw->waiters);
+              rw->writer = w->thread;
+              sema_up (&w->semaphore);
+            }
+          return;
+        }
+      list_pop_front (&rw->waiters);
+      rw->readers++;
+      sema_up (&w->semaphore);
+    }
+}
+
+/* Acquires RW to read, sleeping until no thread holds it to write
+   and no writer of at least the current thread's priority is
+   waiting for it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  struct list_elem *e;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->lock);
+  if (rw->writer == NULL)
+    {
+      for (e = list_begin (&rw->waiters); e != list_end (&rw->waiters);
+           e = list_next (e))
+        {
+          struct rwlock_waiter *w = list_entry (e, struct rwlock_waiter, elem);
+          if (w->thread->priority < thread_get_priority ())
+            break;
+          if (w->write)
+            {
+              rwlock_wait (rw, false);
+              return;
+            }
+        }
+      rw->readers++;
+      lock_release (&rw->lock);
+    }
+  else
+    rwlock_wait (rw, false);
+}
+
+/* Releases RW, which the current thread must hold to read. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0)
+    rwlock_wake (rw);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW to write, sleeping until no other thread holds it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->writer != thread_current ());
+  if (rw->writer == NULL && rw->readers == 0)
+    {
+      rw->writer = thread_current ();
+      lock_release (&rw->lock);
+    }
+  else
+    rwlock_wait (rw, true);
+}
+
+/* Releases RW, which the current thread must hold to write. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->writer == thread_current ());
+  rw->writer = NULL;
+  rwlock_wake (rw);
+  lock_release (&rw->lock);
+}
+
+/* Initializes sequence lock SL.  A sequence lock protects a small
+   value that is read far more often than it is written, such as
+   a tick count.  Readers never block or write shared memory: they
+   copy the value and retry if a write ran meanwhile:
+
+     do
+       {
+         seq = seqlock_read_begin (&sl);
+         copy = value;
+       }
+     while (seqlock_read_retry (&sl, seq));
+
+   Writers are not serialized against each other by the seqlock.
+   The caller must do that, for instance by writing only from an
+   interrupt handler or with interrupts off. */
+void
+seqlock_init (struct seqlock *sl)
+{
+  ASSERT (sl != NULL);
+
+  sl->seq = 0;
+}
+
+/* Starts a read of the value protected by SL.  Returns a value to
+   pass to seqlock_read_retry() once the read is done. */
+unsigned
+seqlock_read_begin (const struct seqlock *sl)
+{
+  unsigned seq = *(volatile const unsigned *) &sl->seq;
+  barrier ();
+  return seq;
+}
+
+/* Returns true if the read begun with seqlock_read_begin(), which
+   returned START, may have seen a partial write and must be
+   done again. */
+bool
+seqlock_read_retry (const struct seqlock *sl, unsigned start)
+{
+  barrier ();
+  return (start & 1) != 0 || *(volatile const unsigned *) &sl->seq != start;
+}
+
+/* Starts a write of the value protected by SL. */
+void
+seqlock_write_begin (struct seqlock *sl)
+{
+  ASSERT ((sl->seq & 1) == 0);
+  sl->seq++;
+  barrier ();
+}
+
+/* Ends a write begun with seqlock_write_begin(). */
+void
+seqlock_write_end (struct seqlock *sl)
+{
+  barrier ();
+  sl->seq++;
+  ASSERT ((sl->seq & 1) == 0);
+}
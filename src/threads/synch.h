@@ -3,6 +3,7 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore 
@@ -22,8 +23,32 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    void *site;                 /* Where the holder called lock_acquire(). */
+    struct lock_prof *prof;     /* Profile, if lock_profile was on. */
   };
 
+/* Contention profile shared by every lock initialized at one
+   place in the code.  Kept only if lock_profile is true. */
+struct lock_prof 
+  {
+    void *init_site;            /* Caller of lock_init(). */
+    unsigned acquire_cnt;       /* Successful acquires. */
+    unsigned contended_cnt;     /* Acquires that found the lock held. */
+    unsigned spin_cnt;          /* ...of which got it without blocking. */
+    int64_t wait_ticks;         /* Total ticks spent waiting. */
+    int64_t max_wait_ticks;     /* Longest single wait. */
+    void *max_holder_site;      /* Holder's acquire site in that wait. */
+  };
+
+/* If true, locks record contention in a struct lock_prof.
+   Controlled by kernel command-line option "-lp". */
+extern bool lock_profile;
+void lock_print_stats (void);
+
+/* Number of times lock_acquire() yields to a runnable holder
+   before it gives up and blocks. */
+#define LOCK_SPIN_MAX 4
+
 void lock_init (struct lock *);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
@@ -41,6 +66,33 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader-writer lock. */
+struct rwlock 
+  {
+    struct lock lock;           /* Guards the members below. */
+    struct list waiters;        /* Waiting threads, highest priority first. */
+    int readers;                /* Number of threads holding it to read. */
+    struct thread *writer;      /* Thread holding it to write, if any. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+
+/* Sequence lock. */
+struct seqlock 
+  {
+    unsigned seq;               /* Odd while a write is in progress. */
+  };
+
+void seqlock_init (struct seqlock *);
+unsigned seqlock_read_begin (const struct seqlock *);
+bool seqlock_read_retry (const struct seqlock *, unsigned start);
+void seqlock_write_begin (struct seqlock *);
+void seqlock_write_end (struct seqlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
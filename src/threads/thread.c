@@ -11,6 +11,7 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "threads/fixed_point.h"
 #ifdef USERPROG
@@ -232,9 +233,11 @@ thread_create (const char *name, int priority,
 	sema_init(&t->sema_load, 0);
 
 	// 파일 디스크립터 관련 부분. 
-	// 파일 디스크립터 테이블을 할당 받고
-	// fdt이 그 처음을 가리키게 하고, next_fd가 2가 되게 한다.
-	t->fdt = palloc_get_page(PAL_ZERO);
+	// 테이블은 처음 파일을 열 때 할당하고(process_add_file),
+	// next_fd가 2가 되게 한다.
+	t->fdt = NULL;
+	t->fdt_size = 0;
+	t->fd_map = NULL;
 	t->next_fd = 2;
 
 	// 나를 나의 부모의 자식리스트에 넣는다. 
@@ -402,11 +405,14 @@ thread_set_priority (int new_priority)
 	// mlfqs면 안함
 	if(true == thread_mlfqs)
 		return ;
-	intr_disable();		// TODO 왜 이거 막아야하는지 알아볼 것
+	// 기부받은 우선순위를 계산하는 동안 lock_acquire가 끼어들면 안됨
+	enum intr_level old_level = intr_disable();
 
-  thread_current ()->priority = new_priority;
+  thread_current ()->init_priority = new_priority;
+	// 기부받은 우선순위가 더 높으면 그것을 유지함
+	refresh_priority();
 
-	intr_enable();
+	intr_set_level(old_level);
 
 	test_max_priority();
 }
@@ -558,6 +564,7 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+  t->init_priority = priority;
   t->magic = THREAD_MAGIC;
   list_push_back (&all_list, &t->allelem);
 
@@ -571,6 +578,7 @@ init_thread (struct thread *t, const char *name, int priority)
 	t->recent_cpu = RECENT_CPU_DEFAULT;
 
 	list_init(&t->childs);
+	list_init(&t->donations);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -666,7 +674,10 @@ schedule (void)
   ASSERT (is_thread (next));
 
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      TRACE_INSTANT (TRACE_SCHEDULE, next->tid, cur->status);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
@@ -774,8 +785,14 @@ void test_max_priority(void) {
 		struct list_elem *e = list_begin(&ready_list);
 		// ready_list의 첫 번째 스레드. ready_list에서 가장 우선순위가 높음
 		struct thread *first_entry = list_entry(e, struct thread, elem);
-		if(first_entry->priority > thread_current()->priority) 
-			thread_yield();
+		// 인터럽트 핸들러(sema_up 등)에서는 바로 양보할 수 없으므로
+		// 핸들러가 끝날 때 양보함
+		if(first_entry->priority > thread_current()->priority) {
+			if(intr_context())
+				intr_yield_on_return();
+			else
+				thread_yield();
+		}
 	}
 }
 
@@ -786,6 +803,63 @@ bool cmp_priority(const struct list_elem *a, const struct list_elem *b,
 				 list_entry(b, struct thread, elem)->priority;
 }
 
+// 현재 스레드가 기다리는 lock의 holder에게 우선순위를 기부함.
+// holder도 다른 lock을 기다리고 있으면 그 holder에게도 기부하며,
+// DONATION_DEPTH_MAX 단계까지만 따라감. 인터럽트를 끈 상태에서 호출
+void donate_priority(void) {
+	struct thread *t = thread_current();
+	int depth;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	for(depth = 0; depth < DONATION_DEPTH_MAX; depth++) {
+		struct thread *holder;
+
+		if(NULL == t->wait_on_lock || NULL == t->wait_on_lock->holder)
+			break;
+		holder = t->wait_on_lock->holder;
+		if(holder->priority >= t->priority)
+			break;
+		holder->priority = t->priority;
+		// ready_list는 우선순위 순이므로 holder의 자리를 다시 찾아줌
+		if(THREAD_READY == holder->status) {
+			list_remove(&holder->elem);
+			list_insert_ordered(&ready_list, &holder->elem, cmp_priority, NULL);
+		}
+		t = holder;
+	}
+}
+
+// lock을 풀 때, 그 lock을 기다리며 나에게 기부했던 스레드들을
+// donations에서 뺌
+void remove_with_lock(struct lock *lock) {
+	struct thread *cur = thread_current();
+	struct list_elem *e;
+
+	for(e = list_begin(&cur->donations); e != list_end(&cur->donations); ) {
+		struct thread *t = list_entry(e, struct thread, donation_elem);
+		if(lock == t->wait_on_lock)
+			e = list_remove(e);
+		else
+			e = list_next(e);
+	}
+}
+
+// 현재 스레드의 우선순위를 원래 우선순위와 남아있는 기부 중 가장
+// 높은 것으로 다시 계산함
+void refresh_priority(void) {
+	struct thread *cur = thread_current();
+	struct list_elem *e;
+
+	cur->priority = cur->init_priority;
+	for(e = list_begin(&cur->donations); e != list_end(&cur->donations);
+			e = list_next(e)) {
+		struct thread *t = list_entry(e, struct thread, donation_elem);
+		if(t->priority > cur->priority)
+			cur->priority = t->priority;
+	}
+}
+
 // thread t의 priority를 mlfq에 맞게 바꿈
 void mlfqs_priority(struct thread *t) {
 	if(idle_thread == t) 
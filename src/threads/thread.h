@@ -25,6 +25,10 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Longest chain of lock holders a priority donation is passed
+   along.  Bounds the work done in lock_acquire(). */
+#define DONATION_DEPTH_MAX 8
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -95,11 +99,19 @@ struct thread
 		int nice;														// for mlfq
 		int recent_cpu;											// for mlfq
 
+		int init_priority;									// 기부받기 전의 원래 우선순위
+		struct lock *wait_on_lock;					// 기다리고 있는 lock
+		struct list donations;							// 나에게 우선순위를 기부한 스레드들
+		struct list_elem donation_elem;			// 다른 스레드의 donations에 들어가기 위함
+
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
 	  struct thread* parent; 						  // 부모를 향한 포인터
 		struct list_elem me_as_child;			  // 나의 부모의 list에 들어가기 위하여
 		struct list mmap_list;							// mmap_file들의 list
+		void *fa_start;											// 지난번 fault-around로 올린 첫 페이지
+		size_t fa_cnt;											// 그 때 올린 페이지 수
+		size_t fa_window;										// 다음 fault-around의 window 크기
 		struct list childs;									// 나의 자식들을 위한 list
 		bool is_loaded;											// 메모리 탑재 유무
 		bool is_ended;											// 종료 유무
@@ -107,16 +119,25 @@ struct thread
 		struct semaphore sema_load;					// load semaphore
 		int exit_status;										// exit status when exit() called;
 		struct file **fdt;									// 파일디스크립터 테이블 포인터
+		int fdt_size;												// fdt의 칸 수. 필요할 때 두 배로 늘림
+		struct bitmap *fd_map;							// fdt에서 사용중인 칸
 		struct file *run_file;							// 현재 실행중인 파일구조체
-		int next_fd;												// 다음 할당할 테이블 주소. 시작값은 2
+		int next_fd;												// 비어있을 수 있는 가장 작은 fd. 시작값은 2
 #ifdef USERPROG
 		/* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    struct pagedir_batch *pd_batch;     /* TLB flushes being deferred. */
 #endif
 
     /* Owned by thread.c. */
 		unsigned magic;                     /* Detects stack overflow. */
 		struct hash vm;											// 스레드의 해시테이블을 관리
+		struct vm_area **vma;								// 시작 주소 순으로 정렬된 영역 배열
+		size_t vma_cnt;											// 영역 개수
+		size_t vma_cap;											// vma 배열의 크기
+		void *heap_start;										// 힙의 시작. 실행 파일의 세그먼트 바로 위
+		void *brk;													// 힙의 끝. sbrk로 옮김
+		void *esp;													// 시스템 콜 진입 시의 유저 esp
 	};
 
 /* If false (default), use round-robin scheduler.
@@ -165,6 +186,11 @@ void test_max_priority(void);
 bool cmp_priority(const struct list_elem *a, const struct list_elem *b,
 									void *aux UNUSED);
 
+//priority donation관련 함수들.
+void donate_priority(void);
+void remove_with_lock(struct lock *lock);
+void refresh_priority(void);
+
 //mlfq관련 함수들.
 void mlfqs_priority(struct thread *t);
 void mlfqs_recent_cpu(struct thread *t);
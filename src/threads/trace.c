@@ -0,0 +1,193 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include <ustar.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Trace file layout.  The ustar file "trace" holds one sector
+   with a struct trace_header, followed by the ring buffer's
+   TRACE_PAGES pages exactly as they are in memory.  The first
+   RECORD_CNT records of the pages are the ring; if TOTAL_CNT
+   exceeds RECORD_CNT, the ring wrapped and the oldest record is
+   at index HEAD, otherwise the records are 0...HEAD-1. */
+#define TRACE_MAGIC "PINTRACE"
+#define TRACE_VERSION 1
+
+struct trace_header
+  {
+    char magic[8];              /* TRACE_MAGIC, not null-terminated. */
+    uint32_t version;           /* TRACE_VERSION. */
+    uint32_t record_size;       /* sizeof (struct trace_record). */
+    uint32_t record_cnt;        /* Capacity of the ring. */
+    uint32_t head;              /* Index of the next record to write. */
+    uint64_t total_cnt;         /* Records ever written. */
+    uint64_t tsc_hz;            /* Time-stamp counter frequency. */
+  };
+
+/* Timer ticks to count time-stamp counter cycles over when
+   working out its frequency. */
+#define TSC_CALIBRATE_TICKS 10
+
+size_t trace_pages;
+bool trace_enabled;
+
+/* The ring buffer. */
+static struct trace_record *trace_buf;
+static uint32_t trace_cnt;
+static uint32_t trace_head;
+static uint64_t trace_total;
+
+static uint64_t measure_tsc_hz (void);
+
+/* Returns the processor's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Allocates the ring buffer and starts recording, if "-tr" was
+   given.  Must be called after palloc_init(). */
+void
+trace_init (void)
+{
+  if (trace_pages == 0)
+    return;
+
+  trace_buf = palloc_get_multiple (PAL_ZERO, trace_pages);
+  if (trace_buf == NULL)
+    PANIC ("couldn't allocate %zu pages for trace buffer", trace_pages);
+  trace_cnt = trace_pages * PGSIZE / sizeof *trace_buf;
+  trace_enabled = true;
+}
+
+/* Records EVENT, with PHASE and arguments ARG0 and ARG1, for the
+   running thread.  Use the TRACE_* macros in threads/trace.h
+   instead of calling this directly. */
+void
+trace_record (enum trace_event event, enum trace_phase phase,
+              uint32_t arg0, uint32_t arg1)
+{
+  /* schedule() records a switch while the outgoing thread is no
+     longer THREAD_RUNNING, which thread_current() would reject,
+     so find the thread from the stack pointer directly. */
+  struct thread *t = pg_round_down (&event);
+  struct trace_record *r;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  r = &trace_buf[trace_head];
+  if (++trace_head >= trace_cnt)
+    trace_head = 0;
+  trace_total++;
+
+  r->tsc = rdtsc ();
+  r->tid = t->tid;
+  r->event = event;
+  r->phase = phase;
+  r->arg[0] = arg0;
+  r->arg[1] = arg1;
+  intr_set_level (old_level);
+}
+
+/* Stops recording and writes the trace to the scratch device as
+   ustar file "trace", for "pintos -G trace" to copy out.  Does
+   nothing if tracing is off.  Like fsutil_append(), writes from
+   the start of the device, so a trace can't be combined with
+   `append' actions. */
+void
+trace_dump (void)
+{
+  size_t size = trace_pages * PGSIZE;
+  struct trace_header *h;
+  struct block *scratch;
+  block_sector_t sector = 0;
+  uint8_t *buffer;
+  size_t ofs;
+
+  if (trace_buf == NULL)
+    return;
+  trace_enabled = false;
+
+  /* Calibrating the TSC and writing the disk both need timer
+     and disk interrupts, which a panic leaves off. */
+  if (intr_get_level () == INTR_OFF)
+    {
+      printf ("trace: interrupts are off, discarding trace\n");
+      return;
+    }
+  scratch = block_get_role (BLOCK_SCRATCH);
+  if (scratch == NULL
+      || block_size (scratch) < DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE) + 4)
+    {
+      printf ("trace: need a scratch device of at least %zu kB, "
+              "discarding trace\n", size / 1024 + 2);
+      return;
+    }
+
+  buffer = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  printf ("Writing %"PRIu64" trace records to scratch device...\n",
+          trace_total < trace_cnt ? trace_total : trace_cnt);
+
+  /* ustar header. */
+  if (!ustar_make_header ("trace", USTAR_REGULAR,
+                          BLOCK_SECTOR_SIZE + size, (char *) buffer))
+    NOT_REACHED ();
+  block_write (scratch, sector++, buffer);
+
+  /* Trace header. */
+  memset (buffer, 0, BLOCK_SECTOR_SIZE);
+  h = (struct trace_header *) buffer;
+  memcpy (h->magic, TRACE_MAGIC, sizeof h->magic);
+  h->version = TRACE_VERSION;
+  h->record_size = sizeof *trace_buf;
+  h->record_cnt = trace_cnt;
+  h->head = trace_head;
+  h->total_cnt = trace_total;
+  h->tsc_hz = measure_tsc_hz ();
+  block_write (scratch, sector++, buffer);
+
+  /* Ring buffer, then the two zero sectors that end a ustar
+     archive. */
+  for (ofs = 0; ofs < size; ofs += BLOCK_SECTOR_SIZE)
+    block_write (scratch, sector++, (uint8_t *) trace_buf + ofs);
+  memset (buffer, 0, BLOCK_SECTOR_SIZE);
+  block_write (scratch, sector++, buffer);
+  block_write (scratch, sector++, buffer);
+
+  palloc_free_page (buffer);
+  palloc_free_multiple (trace_buf, trace_pages);
+  trace_buf = NULL;
+}
+
+/* Returns the time-stamp counter's frequency in Hz, counted
+   over TSC_CALIBRATE_TICKS timer ticks.  Interrupts must be
+   on. */
+static uint64_t
+measure_tsc_hz (void)
+{
+  int64_t start;
+  uint64_t tsc;
+
+  /* Start on a tick boundary. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    barrier ();
+  start = timer_ticks ();
+  tsc = rdtsc ();
+
+  while (timer_elapsed (start) < TSC_CALIBRATE_TICKS)
+    barrier ();
+  return (rdtsc () - tsc) * TIMER_FREQ / TSC_CALIBRATE_TICKS;
+}
@@ -0,0 +1,104 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Kernel event tracing.
+
+   Trace points record fixed-size, time-stamped events into a
+   ring buffer in kernel memory.  At shutdown the buffer is
+   written to the scratch device as a ustar file named "trace",
+   so that "pintos ... -G trace -- -q -tr run ..." copies it out,
+   and "utils/trace2json trace > trace.json" turns it into a
+   file for chrome://tracing or https://ui.perfetto.dev.  (Not
+   "-g trace", which asks the kernel to `append' a file "trace"
+   from the file system.)  A trace of more than 255 pages needs a
+   bigger scratch disk than pintos makes by default; give one
+   with --scratch-size.
+
+   Trace points are compiled in only if TRACE is defined, which
+   "make TRACE=1" does (after a "make clean").  Otherwise they
+   compile to nothing.  Even when compiled in, they record only
+   if the kernel was started with "-tr". */
+
+/* Events.  The arguments listed are those of the instant or
+   begin record, followed by those of the end record where they
+   differ.  The decoder, utils/trace2json, knows these by number,
+   so only add to the end. */
+enum trace_event
+  {
+    TRACE_SCHEDULE,             /* Context switch: next tid, old status. */
+    TRACE_SYSCALL,              /* System call: number; return value. */
+    TRACE_PAGE_FAULT,           /* Page fault: address, error code;
+                                   whether the page was loaded. */
+    TRACE_EVICT,                /* Page eviction: user address, owner tid. */
+    TRACE_BLOCK_READ,           /* Sector read: block type, sector. */
+    TRACE_BLOCK_WRITE,          /* Sector write: block type, sector. */
+    TRACE_LOCK_WAIT,            /* Lock wait: lock address, holder tid;
+                                   whether it was acquired by spinning. */
+    TRACE_EXIT                  /* Process exit: status.  Ends any
+                                   interval the thread left open. */
+  };
+
+/* Whether an event is a point in time or begins or ends an
+   interval on the recording thread. */
+enum trace_phase
+  {
+    TRACE_PHASE_INSTANT,
+    TRACE_PHASE_BEGIN,
+    TRACE_PHASE_END
+  };
+
+/* One trace record, as written to the trace file. */
+struct trace_record
+  {
+    uint64_t tsc;               /* Time-stamp counter. */
+    int32_t tid;                /* Recording thread. */
+    uint16_t event;             /* enum trace_event. */
+    uint16_t phase;             /* enum trace_phase. */
+    uint32_t arg[2];            /* Event-specific arguments. */
+  };
+
+/* Number of pages of trace records to keep, or 0 if tracing is
+   off.  Controlled by kernel command-line option "-tr". */
+extern size_t trace_pages;
+
+/* True while trace points should record. */
+extern bool trace_enabled;
+
+void trace_init (void);
+void trace_record (enum trace_event, enum trace_phase,
+                   uint32_t arg0, uint32_t arg1);
+void trace_dump (void);
+
+#ifdef TRACE
+#define TRACE_RECORD(EVENT, PHASE, ARG0, ARG1)                          \
+        do                                                              \
+          {                                                             \
+            if (trace_enabled)                                          \
+              trace_record (EVENT, PHASE, (uint32_t) (ARG0),            \
+                            (uint32_t) (ARG1));                         \
+          }                                                             \
+        while (0)
+#else
+/* Still type-checks the arguments, then compiles to nothing. */
+#define TRACE_RECORD(EVENT, PHASE, ARG0, ARG1)                          \
+        do                                                              \
+          {                                                             \
+            if (0)                                                      \
+              trace_record (EVENT, PHASE, (uint32_t) (ARG0),            \
+                            (uint32_t) (ARG1));                         \
+          }                                                             \
+        while (0)
+#endif
+
+#define TRACE_INSTANT(EVENT, ARG0, ARG1) \
+        TRACE_RECORD (EVENT, TRACE_PHASE_INSTANT, ARG0, ARG1)
+#define TRACE_BEGIN(EVENT, ARG0, ARG1) \
+        TRACE_RECORD (EVENT, TRACE_PHASE_BEGIN, ARG0, ARG1)
+#define TRACE_END(EVENT, ARG0, ARG1) \
+        TRACE_RECORD (EVENT, TRACE_PHASE_END, ARG0, ARG1)
+
+#endif /* threads/trace.h */
@@ -4,6 +4,7 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "userprog/syscall.h"
 #include "userprog/process.h"
 #include "vm/page.h"
@@ -151,18 +152,28 @@ page_fault (struct intr_frame *f)
   not_present = (f->error_code & PF_P) == 0;
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
+	TRACE_BEGIN(TRACE_PAGE_FAULT, fault_addr, f->error_code);
 
 	// fault_addr의 유효성 검사(check_address)
 	// fault_addr를 이용해 vme를 찾고, 
 	// fault handler를 호출한다.
 	// 이후에는 물리 메모리에 로드 여부를 검사한다.
-	check_address(fault_addr, f->esp);
+	// 커널 모드에서 난 fault면 f->esp는 커널 스택이므로 시스템 콜 진입
+	// 때 저장해둔 유저 esp로 스택 확장 여부를 판단
+	struct vm_entry *vme = check_address(fault_addr,
+																			 user ? f->esp : thread_current()->esp);
 	if(not_present) {
-		struct vm_entry *vme = find_vme(fault_addr);
 		// vme가 NULL이면 해시 테이블에 없는 것 
 		if(NULL != vme)
 			loaded = handle_mm_fault(vme);
 	}
+	// 있는 페이지에 쓰다가 fault난 경우. fork로 공유중인 페이지이거나,
+	// 읽기 전용으로 맵핑되는 4MB 큰 페이지 안의 페이지일 수 있음
+	else if(write) {
+		if(NULL != vme)
+			loaded = handle_cow_fault(vme);
+	}
+	TRACE_END(TRACE_PAGE_FAULT, fault_addr, loaded);
 	if(false == loaded) {
 		exit(-1);
 	}
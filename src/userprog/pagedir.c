@@ -5,9 +5,24 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *, bool deferrable);
+static void flush_batch (struct pagedir_batch *);
+static void demote_page (uint32_t *pd, uint32_t *pde);
+
+/* Each user page directory is followed by a second page that
+   remembers, for every PDE that has been promoted to a 4 MB
+   page, the page table it was promoted from.  The page table is
+   kept up to date while the large page is in use, so demoting
+   never has to allocate memory. */
+static uint32_t **
+saved_pts (uint32_t *pd)
+{
+  return (uint32_t **) (pd + PGSIZE / sizeof *pd);
+}
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -16,9 +31,12 @@ static void invalidate_pagedir (uint32_t *);
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
+  uint32_t *pd = palloc_get_multiple (0, 2);
   if (pd != NULL)
-    memcpy (pd, init_page_dir, PGSIZE);
+    {
+      memcpy (pd, init_page_dir, PGSIZE);
+      memset (saved_pts (pd), 0, PGSIZE);
+    }
   return pd;
 }
 
@@ -36,7 +54,11 @@ pagedir_destroy (uint32_t *pd)
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
     if (*pde & PTE_P) 
       {
-        uint32_t *pt = pde_get_pt (*pde);
+        uint32_t *pt;
+
+        if (*pde & PTE_PS)
+          demote_page (pd, pde);
+        pt = pde_get_pt (*pde);
         uint32_t *pte;
         
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
@@ -44,7 +66,7 @@ pagedir_destroy (uint32_t *pd)
             palloc_free_page (pte_get_page (*pte));
         palloc_free_page (pt);
       }
-  palloc_free_page (pd);
+  palloc_free_multiple (pd, 2);
 }
 
 /* Returns the address of the page table entry for virtual
@@ -52,7 +74,10 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+   If VADDR lies in a 4 MB page, the large page is first split
+   back into 4 kB pages, since the caller is about to look at or
+   change a single PTE. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -66,6 +91,8 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
   /* Check for a page table for VADDR.
      If one is missing, create one if requested. */
   pde = pd + pd_no (vaddr);
+  if (*pde & PTE_PS)
+    demote_page (pd, pde);
   if (*pde == 0) 
     {
       if (create)
@@ -126,8 +153,13 @@ void *
 pagedir_get_page (uint32_t *pd, const void *uaddr) 
 {
   uint32_t *pte;
+  uint32_t pde;
 
   ASSERT (is_user_vaddr (uaddr));
+
+  pde = pd[pd_no (uaddr)];
+  if (pde_is_large (pde))
+    return pde_get_large_page (pde) + ((uintptr_t) uaddr & (PTSPAN - 1));
   
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
@@ -152,7 +184,25 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage, false);
+    }
+}
+
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PD.  Used to write-protect pages that are shared
+   copy-on-write and to make them writable again once they are
+   private. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL) 
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_page (pd, vpage, false);
     }
 }
 
@@ -163,7 +213,12 @@ pagedir_clear_page (uint32_t *pd, void *upage)
 bool
 pagedir_is_dirty (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t pde = pd[pd_no (vpage)];
+  uint32_t *pte;
+
+  if (pde_is_large (pde))
+    return (saved_pts (pd)[pd_no (vpage)][pt_no (vpage)] & PTE_D) != 0;
+  pte = lookup_page (pd, vpage, false);
   return pte != NULL && (*pte & PTE_D) != 0;
 }
 
@@ -180,7 +235,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage, false);
         }
     }
 }
@@ -192,16 +247,40 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
 bool
 pagedir_is_accessed (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t pde = pd[pd_no (vpage)];
+  uint32_t *pte;
+
+  if (pde_is_large (pde))
+    return (pde & PTE_A) != 0;
+  pte = lookup_page (pd, vpage, false);
   return pte != NULL && (*pte & PTE_A) != 0;
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD.
+   Inside pagedir_batch_begin() and pagedir_batch_end(), clearing
+   the bit does not take effect in the TLB until the batch ends.
+   The CPU keeps a single accessed bit for a 4 MB page.  Setting
+   it for a page inside one sets it for the whole large page, but
+   clearing it would make all 1024 pages look idle for the sake
+   of one, so the large page is split first. */
 void
 pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pde = pd + pd_no (vpage);
+  uint32_t *pte;
+
+  if (pde_is_large (*pde))
+    {
+      if (accessed)
+        {
+          *pde |= PTE_A;
+          return;
+        }
+      demote_page (pd, pde);
+    }
+
+  pte = lookup_page (pd, vpage, false);
   if (pte != NULL) 
     {
       if (accessed)
@@ -209,11 +288,200 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage, true);
         }
     }
 }
 
+/* Harvests the accessed and dirty bits of the user pages from
+   START up to END in PD, walking each page table once instead of
+   looking every page up from the page directory.  Stores the
+   PTE_A and PTE_D bits of the page at START + i * PGSIZE in
+   BITS[i], or 0 if that page is not present, and then clears the
+   bits given in CLEAR: PTE_A, PTE_D, both or neither.  Returns
+   the number of present pages.
+
+   The TLB is invalidated once for the whole range, when the scan
+   ends: page by page if few pages changed, otherwise by a single
+   flush.  A scan that only clears accessed bits inside
+   pagedir_batch_begin() leaves its invalidations to the batch.
+
+   The CPU keeps a single accessed bit for a 4 MB page, which
+   every page inside it reports.  Dirty bits stay page by page in
+   the saved page table, since a large page is never writable
+   (see pagedir_promote()).  Clearing the dirty bit splits the
+   large page anyway, so that later writes are tracked in the
+   page table.  So does clearing the accessed bit for only part
+   of the page, as the clock algorithm does one page at a time;
+   otherwise a single scan would age all 1024 pages at once. */
+size_t
+pagedir_scan_range (uint32_t *pd, const void *start, const void *end,
+                    uint32_t clear, uint32_t *bits)
+{
+  struct thread *t = thread_current ();
+  struct pagedir_batch *outer = t->pd_batch;
+  struct pagedir_batch local;
+  const uint8_t *upage = start;
+  size_t present = 0;
+
+  ASSERT (pg_ofs (start) == 0);
+  ASSERT (start <= end && end <= PHYS_BASE);
+  ASSERT ((clear & ~(uint32_t) (PTE_A | PTE_D)) == 0);
+
+  /* Clearing a dirty bit cannot wait for the caller's batch, since
+     the caller is about to act on it.  Within the scan itself
+     deferring is safe: the process this PD belongs to cannot run
+     before the scan returns. */
+  if (outer == NULL || (clear & PTE_D) != 0)
+    {
+      local.cnt = 0;
+      t->pd_batch = &local;
+    }
+
+  while (upage < (const uint8_t *) end)
+    {
+      uint32_t *pde = pd + pd_no (upage);
+      const uint8_t *limit = (const uint8_t *) ((pd_no (upage) + 1) * PTSPAN);
+
+      if (limit > (const uint8_t *) end)
+        limit = end;
+      if (pde_is_large (*pde)
+          && ((clear & PTE_D) != 0
+              || ((clear & PTE_A) != 0 && limit - upage != PTSPAN)))
+        demote_page (pd, pde);
+
+      if ((*pde & PTE_P) == 0)
+        for (; upage < limit; upage += PGSIZE)
+          *bits++ = 0;
+      else if (pde_is_large (*pde))
+        {
+          uint32_t *pt = saved_pts (pd)[pde - pd];
+          uint32_t accessed = *pde & PTE_A;
+
+          /* Only a scan of the whole large page gets here with
+             bits to clear, and only with PTE_A.  Clear the saved
+             PTEs too, so demotion doesn't bring back a stale
+             accessed bit. */
+          if (accessed & clear)
+            {
+              size_t i;
+
+              for (i = 0; i < PGSIZE / sizeof *pt; i++)
+                pt[i] &= ~(uint32_t) PTE_A;
+              *pde &= ~(uint32_t) PTE_A;
+              invalidate_page (pd, upage, true);
+            }
+          present += (limit - upage) / PGSIZE;
+          for (; upage < limit; upage += PGSIZE)
+            *bits++ = accessed | (pt[pt_no (upage)] & PTE_D);
+        }
+      else
+        {
+          uint32_t *pt = pde_get_pt (*pde);
+
+          for (; upage < limit; upage += PGSIZE)
+            {
+              uint32_t *pte = pt + pt_no (upage);
+
+              if ((*pte & PTE_P) == 0)
+                {
+                  *bits++ = 0;
+                  continue;
+                }
+              *bits++ = *pte & (PTE_A | PTE_D);
+              present++;
+              if (*pte & clear)
+                {
+                  *pte &= ~clear;
+                  invalidate_page (pd, upage, true);
+                }
+            }
+        }
+    }
+
+  if (t->pd_batch == &local)
+    {
+      t->pd_batch = outer;
+      flush_batch (&local);
+    }
+  return present;
+}
+
+/* Tries to replace the page table that covers user virtual
+   address VADDR in PD by a single 4 MB page.  This succeeds only
+   if all 1,024 pages in the table are present, have the same
+   permissions, and are backed by physically contiguous frames
+   whose first frame is 4 MB aligned.  Returns true if the pages
+   are now mapped by a large page, false otherwise.
+
+   The CPU would keep a single dirty bit for the large page, so
+   writing back one page would mean writing back all 1024 of
+   them.  Instead, the large page is always mapped read-only.
+   The first write to it faults, as a copy-on-write fault does.
+   Making the page writable then splits the large page, and the
+   write is tracked in its own PTE.  The dirty bits from before
+   promotion stay in the saved page table. */
+bool
+pagedir_promote (uint32_t *pd, const void *vaddr)
+{
+  uint32_t *pde, *pt;
+  uint32_t base, flags, bits = 0;
+  size_t i, cnt;
+
+  ASSERT (is_user_vaddr (vaddr));
+  ASSERT (pd != init_page_dir);
+
+  pde = pd + pd_no (vaddr);
+  if ((*pde & PTE_P) == 0)
+    return false;
+  if (*pde & PTE_PS)
+    return true;
+
+  /* Check the first and last entries before walking the whole
+     table, so that the usual failing case stays cheap. */
+  pt = pde_get_pt (*pde);
+  cnt = PGSIZE / sizeof *pt;
+  base = pt[0] & PTE_ADDR;
+  flags = pt[0] & (PTE_P | PTE_W | PTE_U);
+  if ((flags & PTE_P) == 0 || base % PTSPAN != 0
+      || (pt[cnt - 1] & PTE_ADDR) != base + (cnt - 1) * PGSIZE)
+    return false;
+  for (i = 0; i < cnt; i++)
+    {
+      if ((pt[i] & PTE_ADDR) != base + i * PGSIZE
+          || (pt[i] & (PTE_P | PTE_W | PTE_U)) != flags)
+        return false;
+      bits |= pt[i] & PTE_A;
+    }
+
+  saved_pts (pd)[pde - pd] = pt;
+  *pde = base | (flags & ~(uint32_t) PTE_W) | bits | PTE_PS;
+  invalidate_pagedir (pd);
+  return true;
+}
+
+/* Splits the 4 MB page mapped by large page directory entry PDE
+   in PD back into the page table it was promoted from.  The CPU
+   records accessed only for the large page as a whole, so that
+   bit is copied into every PTE.  The large page is read-only, so
+   the PTEs' dirty bits are still exact. */
+static void
+demote_page (uint32_t *pd, uint32_t *pde)
+{
+  uint32_t *pt = saved_pts (pd)[pde - pd];
+  uint32_t bits = *pde & PTE_A;
+  size_t i;
+
+  ASSERT (pde_is_large (*pde));
+  ASSERT (pt != NULL);
+
+  for (i = 0; i < PGSIZE / sizeof *pt; i++)
+    pt[i] |= bits;
+  *pde = pde_create (pt);
+  saved_pts (pd)[pde - pd] = NULL;
+  invalidate_pagedir (pd);
+}
+
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void
@@ -230,6 +498,13 @@ pagedir_activate (uint32_t *pd)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
+/* Returns true if PD is the page directory loaded in CR3. */
+bool
+pagedir_is_active (uint32_t *pd) 
+{
+  return active_pd () == pd;
+}
+
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd (void) 
@@ -261,3 +536,74 @@ invalidate_pagedir (uint32_t *pd)
       pagedir_activate (pd);
     } 
 }
+
+/* Flushes the CPU's TLB entry for virtual address VADDR, if PD is
+   the active page directory.  One invlpg leaves the rest of the
+   TLB alone, unlike reloading CR3.  See [IA32-v3a] 3.12
+   "Translation Lookaside Buffers (TLBs)".
+
+   If DEFERRABLE and the current thread is inside a batch, the
+   flush is queued until pagedir_batch_end() instead.  Only
+   changes that the CPU may safely miss for a while are
+   deferrable: clearing the accessed bit only delays when the CPU
+   sets it again.  Dropping a mapping or write access, or
+   clearing the dirty bit, must take effect at once. */
+static void
+invalidate_page (uint32_t *pd, const void *vaddr, bool deferrable) 
+{
+  struct pagedir_batch *b = thread_current ()->pd_batch;
+
+  if (active_pd () != pd)
+    return;
+  if (deferrable && b != NULL)
+    {
+      if (b->cnt < PAGEDIR_BATCH_MAX)
+        b->pages[b->cnt] = vaddr;
+      b->cnt++;
+    }
+  else
+    asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+}
+
+/* Starts a batch of page table updates by the current thread, in
+   which deferrable TLB invalidations are collected in B and done
+   together by pagedir_batch_end().  Meant for sweeps that clear
+   the accessed bits of many pages.  Batches do not nest. */
+void
+pagedir_batch_begin (struct pagedir_batch *b) 
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->pd_batch == NULL);
+  b->cnt = 0;
+  t->pd_batch = b;
+}
+
+/* Ends the batch started with B, invalidating each queued page,
+   or the whole TLB if more than PAGEDIR_BATCH_MAX were queued.
+   A context switch in between is harmless: switching page
+   directories flushes the TLB anyway, and invalidating a page
+   again is merely redundant. */
+void
+pagedir_batch_end (struct pagedir_batch *b) 
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->pd_batch == b);
+  t->pd_batch = NULL;
+  flush_batch (b);
+}
+
+/* Invalidates each page queued in B, or the whole TLB if more
+   than PAGEDIR_BATCH_MAX were queued. */
+static void
+flush_batch (struct pagedir_batch *b) 
+{
+  size_t i;
+
+  if (b->cnt > PAGEDIR_BATCH_MAX)
+    pagedir_activate (active_pd ());
+  else
+    for (i = 0; i < b->cnt; i++)
+      asm volatile ("invlpg (%0)" : : "r" (b->pages[i]) : "memory");
+}
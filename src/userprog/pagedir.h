@@ -2,17 +2,36 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Most TLB invalidations a batch remembers page by page.  A
+   batch that grows past this flushes the whole TLB at its end. */
+#define PAGEDIR_BATCH_MAX 32
+
+/* TLB invalidations deferred by pagedir_batch_begin(). */
+struct pagedir_batch
+  {
+    size_t cnt;                         /* Pages queued, or more. */
+    const void *pages[PAGEDIR_BATCH_MAX]; /* Pages to invalidate. */
+  };
+
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
+bool pagedir_promote (uint32_t *pd, const void *upage);
+size_t pagedir_scan_range (uint32_t *pd, const void *start, const void *end,
+                           uint32_t clear, uint32_t *bits);
 void pagedir_activate (uint32_t *pd);
+bool pagedir_is_active (uint32_t *pd);
+void pagedir_batch_begin (struct pagedir_batch *);
+void pagedir_batch_end (struct pagedir_batch *);
 
 #endif /* userprog/pagedir.h */
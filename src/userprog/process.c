@@ -1,5 +1,6 @@
 #include "userprog/process.h"
 #include "userprog/syscall.h"
+#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
 #include <round.h>
@@ -16,6 +17,7 @@
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
+#include "threads/pte.h"
 #include "threads/malloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
@@ -24,7 +26,22 @@
 #include "vm/frame.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static bool fork_mmap (struct thread *parent);
+static bool fork_vm (struct thread *parent);
+static bool fork_files (struct thread *parent);
+static bool fdt_grow (struct thread *t, int size);
+
+// fd 테이블의 처음 크기와 최대 크기(칸 수)
+#define FDT_INIT_SIZE 16
+#define FDT_MAX 4096
+
+// fork시 부모가 자식에게 넘겨주는 정보
+struct fork_args {
+	struct thread *parent;						// fork를 호출한 부모
+	struct intr_frame if_;						// 부모의 유저 레지스터 상태
+};
 
 // 아래 두 함수는 vm관련 함수임
 bool load_file(void *kaddr, struct vm_entry *vme); 
@@ -132,6 +149,313 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+// 현재 프로세스를 복제한 자식 프로세스를 만든다. F는 부모가 시스템 콜을
+// 호출한 시점의 인터럽트 프레임이며 자식은 여기서부터 실행을 재개한다.
+// 주소 공간은 복사하지 않고 프레임을 공유하며, 쓰기 가능한 페이지는
+// 양쪽 모두 읽기 전용으로 맵핑해서 처음 쓰기할 때 복사한다(COW).
+// 자식의 tid를 리턴. 실패시 TID_ERROR
+tid_t
+process_fork (struct intr_frame *f)
+{
+	struct thread *cur = thread_current();
+	struct thread *child;
+	struct fork_args *args;
+	tid_t tid;
+
+	// 자식이 받아가서 free함
+	args = malloc(sizeof *args);
+	if(NULL == args)
+		return TID_ERROR;
+	args->parent = cur;
+	memcpy(&args->if_, f, sizeof args->if_);
+
+	tid = thread_create(cur->name, PRI_DEFAULT, start_fork, args);
+	if(TID_ERROR == tid) {
+		free(args);
+		return TID_ERROR;
+	}
+
+	// exec()와 마찬가지로 자식이 복제를 끝낼 때까지 기다림.
+	// sema_up은 start_fork에서 함.
+	child = get_child_process(tid);
+	sema_down(&child->sema_load);
+
+	return child->is_loaded ? tid : TID_ERROR;
+}
+
+// fork된 자식이 처음 실행하는 함수. 부모의 주소 공간과 파일들을 복제한 뒤
+// 부모가 시스템 콜을 부른 지점으로 돌아간다. 자식에게 fork는 0을 리턴.
+static void
+start_fork (void *args_)
+{
+	struct fork_args *args = args_;
+	struct thread *parent = args->parent;
+	struct thread *t = thread_current();
+  struct intr_frame if_;
+	bool success = false;
+
+	memcpy(&if_, &args->if_, sizeof if_);
+	free(args);
+
+	vm_init(&t->vm);
+	list_init(&t->mmap_list);
+
+	// 자식의 page directory를 만들고 활성화
+  t->pagedir = pagedir_create ();
+  if (t->pagedir != NULL) {
+		process_activate ();
+		success = fork_files(parent) && fork_mmap(parent) && fork_vm(parent);
+	}
+
+	// 부모를 깨움. 부모는 process_fork에서 잠들어 있음
+	t->is_loaded = success;
+	sema_up(&t->sema_load);
+
+	if(!success)
+		thread_exit();
+
+	// 자식에서의 fork 리턴값은 0
+	if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+// 부모의 실행 파일과 파일 디스크립터 테이블을 복제.
+// struct file은 공유할 수 없으므로 다시 열고 위치(pos)만 맞춰준다.
+static bool
+fork_files (struct thread *parent)
+{
+	struct thread *t = thread_current();
+	bool success = true;
+	int fd;
+
+	if(NULL != parent->run_file) {
+		t->run_file = file_reopen(parent->run_file);
+		if(NULL == t->run_file)
+			success = false;
+		else
+			file_deny_write(t->run_file);
+	}
+
+	if(success && 0 < parent->fdt_size)
+		success = fdt_grow(t, parent->fdt_size);
+	for(fd = 2; success && fd < parent->fdt_size; fd++) {
+		struct file *f = NULL;
+		int prev;
+
+		if(NULL == parent->fdt[fd])
+			continue;
+		// dup으로 같은 파일을 가리키는 fd는 자식에서도 같은 파일을 가리킴
+		for(prev = 2; prev < fd; prev++)
+			if(parent->fdt[prev] == parent->fdt[fd]) {
+				f = file_dup(t->fdt[prev]);
+				break;
+			}
+		if(NULL == f) {
+			f = file_reopen(parent->fdt[fd]);
+			if(NULL == f) {
+				success = false;
+				break;
+			}
+			file_seek(f, file_tell(parent->fdt[fd]));
+		}
+		t->fdt[fd] = f;
+		bitmap_mark(t->fd_map, fd);
+	}
+	t->next_fd = parent->next_fd;
+
+	return success;
+}
+
+// 부모의 mmap_file들을 복제. mmap된 페이지는 파일과 공유되는 것이므로
+// COW로 나누지 않는다. 부모의 dirty 페이지를 파일에 먼저 기록한 뒤
+// 자식은 맵핑만 만들어두고 필요할 때 파일에서 읽게 한다.
+static bool
+fork_mmap (struct thread *parent)
+{
+	struct thread *t = thread_current();
+	struct list_elem *e, *v;
+	struct writeback *wbs;
+	uint32_t *bits;
+	size_t npages, n, k;
+
+	for(e = list_begin(&parent->mmap_list); e != list_end(&parent->mmap_list);
+			e = list_next(e)) {
+		struct mmap_file *pf = list_entry(e, struct mmap_file, elem);
+		struct mmap_file *mmp_f = malloc(sizeof *mmp_f);
+		if(NULL == mmp_f)
+			return false;
+		list_init(&mmp_f->vme_list);
+		mmp_f->mapid = pf->mapid;
+		mmp_f->file = file_reopen(pf->file);
+		mmp_f->vma = NULL;
+		list_push_back(&t->mmap_list, &mmp_f->elem);
+		if(NULL == mmp_f->file)
+			return false;
+
+		// 영역은 새로 연 파일을 가리키도록 복제
+		mmp_f->vma = malloc(sizeof *mmp_f->vma);
+		if(NULL == mmp_f->vma)
+			return false;
+		memcpy(mmp_f->vma, pf->vma, sizeof *mmp_f->vma);
+		mmp_f->vma->file = mmp_f->file;
+		mmp_f->vma->mmap_file = mmp_f;
+		if(!insert_vma(mmp_f->vma)) {
+			free(mmp_f->vma);
+			mmp_f->vma = NULL;
+			return false;
+		}
+
+		// 부모 영역의 dirty bit를 한 번에 읽고 지운 뒤 dirty 페이지만 기록.
+		// 기록할 프레임은 lru_list_lock을 잡고 골라서 참조해 두고, 기록은
+		// writeback_finish가 lock을 놓고 하므로 그동안 다른 fault를 막지 않음.
+		// 부모의 주소 공간은 활성화되어 있지 않으므로 커널 주소로 기록
+		npages = (pf->vma->end - pf->vma->start) / PGSIZE;
+		bits = malloc(npages * sizeof *bits);
+		wbs = malloc(npages * sizeof *wbs);
+		if(NULL == bits || NULL == wbs) {
+			free(bits);
+			free(wbs);
+			return false;
+		}
+		lock_acquire(&lru_list_lock);
+		pagedir_scan_range(parent->pagedir, pf->vma->start, pf->vma->end,
+											 PTE_D, bits);
+		n = 0;
+		for(v = list_begin(&pf->vme_list); v != list_end(&pf->vme_list);
+				v = list_next(v)) {
+			struct vm_entry *pvme = list_entry(v, struct vm_entry, mmap_elem);
+			size_t i = (pvme->vaddr - pf->vma->start) / PGSIZE;
+			if(pvme->is_loaded && (bits[i] & PTE_D))
+				writeback_start(&wbs[n++], pvme,
+												pagedir_get_page(parent->pagedir, pvme->vaddr));
+		}
+		for(k = 0; k < n; k++)
+			writeback_finish(&wbs[k]);
+		lock_release(&lru_list_lock);
+		free(wbs);
+		free(bits);
+
+		for(v = list_begin(&pf->vme_list); v != list_end(&pf->vme_list);
+				v = list_next(v)) {
+			struct vm_entry *pvme = list_entry(v, struct vm_entry, mmap_elem);
+			struct vm_entry *vme = malloc(sizeof *vme);
+			if(NULL == vme)
+				return false;
+
+			memcpy(vme, pvme, sizeof *vme);
+			vme->file = mmp_f->file;
+			vme->is_loaded = false;
+			vme->page = NULL;
+			insert_vme(&t->vm, vme);
+			list_push_back(&mmp_f->vme_list, &vme->mmap_elem);
+		}
+	}
+	return true;
+}
+
+// 부모의 vm_entry들을 복제. mmap 영역은 fork_mmap에서 처리했음.
+// 메모리에 있는 페이지는 프레임을 공유하고 양쪽 다 읽기 전용으로 맵핑,
+// 스왑된 페이지는 스왑 슬롯을 복사한다.
+static bool
+fork_vm (struct thread *parent)
+{
+	struct thread *t = thread_current();
+	struct hash_iterator i;
+	struct vm_entry **swapped;		// 스왑 슬롯을 복사해야 하는 vm_entry들
+	size_t swapped_cnt = 0;
+	bool success = true;
+	size_t n;
+
+	// mmap이 아닌 영역들을 복제. 실행 파일은 자식이 새로 연 것을 가리킴
+	for(n = 0; n < parent->vma_cnt; n++) {
+		struct vm_area *pvma = parent->vma[n];
+		struct vm_area *vma;
+
+		if(NULL != pvma->mmap_file)
+			continue;
+		vma = malloc(sizeof *vma);
+		if(NULL == vma)
+			return false;
+		memcpy(vma, pvma, sizeof *vma);
+		if(parent->run_file == pvma->file)
+			vma->file = t->run_file;
+		if(!insert_vma(vma)) {
+			free(vma);
+			return false;
+		}
+	}
+
+	t->heap_start = parent->heap_start;
+	t->brk = parent->brk;
+
+	swapped = malloc(hash_size(&parent->vm) * sizeof *swapped);
+	if(NULL == swapped && 0 < hash_size(&parent->vm))
+		return false;
+
+	// 복제 도중에 부모의 페이지가 evict되면 안되므로 lock.
+	// 스왑 슬롯의 복사는 디스크 I/O라서 여기서는 부모의 슬롯을 기억만 해둠
+	lock_acquire(&lru_list_lock);
+	hash_first(&i, &parent->vm);
+	while(success && hash_next(&i)) {
+		struct vm_entry *pvme = hash_entry(hash_cur(&i), struct vm_entry, elem);
+		struct vm_entry *vme;
+
+		if(VM_FILE == pvme->type)
+			continue;
+
+		vme = malloc(sizeof *vme);
+		if(NULL == vme) {
+			success = false;
+			break;
+		}
+		memcpy(vme, pvme, sizeof *vme);
+		vme->page = NULL;
+		if(parent->run_file == pvme->file)
+			vme->file = t->run_file;
+
+		if(pvme->is_loaded) {
+			void *kaddr = pagedir_get_page(parent->pagedir, pvme->vaddr);
+			struct page *page = malloc(sizeof *page);
+			if(NULL == page
+				 || !pagedir_set_page(t->pagedir, vme->vaddr, kaddr, false)) {
+				free(page);
+				free(vme);
+				success = false;
+				break;
+			}
+			// 부모 쪽도 쓰기 금지. 먼저 쓰는 쪽이 handle_cow_fault에서 복사함
+			if(pvme->writable)
+				pagedir_set_writable(parent->pagedir, pvme->vaddr, false);
+			frame_ref(kaddr);
+			page->kaddr = kaddr;
+			page->vme = vme;
+			page->thread = t;
+			page->pinned = 0;
+			vme->page = page;
+			add_page_to_lru_list(page);
+		}
+		else if(VM_ANON == pvme->type)
+			swapped[swapped_cnt++] = vme;
+		insert_vme(&t->vm, vme);
+	}
+	lock_release(&lru_list_lock);
+
+	// 스왑된 페이지는 lock을 놓고 복사. 부모는 process_fork에서 자고 있으므로
+	// 그동안 부모의 스왑 슬롯이 반납되지 않고, 이 vm_entry들은 올라와 있지
+	// 않으므로 evict와도 상관없음. 실패하면 남은 것들이 부모의 슬롯을
+	// 가리키지 않게 비워둠
+	for(n = 0; n < swapped_cnt; n++) {
+		struct vm_entry *vme = swapped[n];
+		vme->swap_slot = success ? swap_copy(vme->swap_slot) : BITMAP_ERROR;
+		if(BITMAP_ERROR == vme->swap_slot)
+			success = false;
+	}
+	free(swapped);
+
+	return success;
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -191,12 +515,12 @@ process_exit (void)
 {
   struct thread *cur = thread_current ();
   uint32_t *pd;
-	int cur_fd_index = cur->next_fd;	// 현재 스레드의 fd인덱스를 저장.
 
 	// 모든 mmap_file을 삭제
 	munmap(-1);
 	free_all_pages(cur->tid);
 	vm_destroy(&cur->vm);
+	vma_destroy();
 
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
@@ -216,11 +540,7 @@ process_exit (void)
 	}
 
 	// 아래는 fdt관련 파일 닫는 부분임. 
-	while(cur_fd_index > 2) { // 2까지만. 0, 1은 원래 있으니까.
-		process_close_file(cur_fd_index - 1);
-		cur_fd_index--;
-	}
-	palloc_free_page(cur->fdt);	// get_page한거 free
+	process_close_all_files();
 	// file_close여기서 한다.
 	file_close(cur->run_file);
 
@@ -234,8 +554,16 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables.  Loading CR3 flushes every
+     non-global TLB entry, so skip it when they are already
+     loaded.  A kernel thread has no user mappings of its own and
+     keeps running on whichever page directory was active before
+     (lazy TLB): all of them map the kernel alike.  Switching from
+     a process to kernel threads and back then costs no flush.
+     process_exit() moves to the base page directory before
+     destroying its own, so a borrowed one is never freed. */
+  if (t->pagedir != NULL && !pagedir_is_active (t->pagedir))
+    pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
@@ -331,21 +659,17 @@ load (const char *file_name, void (**eip) (void), void **esp)
     goto done;
   process_activate ();
 
-	//락을 건다. 로드 하는 동안 누가 건들면 안되기 때문에
-	lock_acquire(&filesys_lock);
   /* Open executable file. */
   file = filesys_open (file_name);
   if (file == NULL) 
     {
-			lock_release(&filesys_lock);		// 락 해제
       printf ("load: %s: open failed\n", file_name);
       goto done; 
     }
 
-	// 읽기 전에, run_file 설정 해주고, file_deny_write호출하자. 언락도 하고.
+	// 읽기 전에, run_file 설정 해주고, file_deny_write호출하자.
 	t->run_file = file;
 	file_deny_write(file);
-	lock_release(&filesys_lock);
 
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
@@ -419,6 +743,11 @@ load (const char *file_name, void (**eip) (void), void **esp)
         }
     }
 
+  // 힙은 세그먼트들 중 가장 높은 것 바로 위에서 시작. 처음엔 비어있고
+  // sbrk로 늘릴 때 영역을 만든다
+  if (0 < t->vma_cnt)
+    t->heap_start = t->brk = t->vma[t->vma_cnt - 1]->end;
+
   /* Set up stack. */
   if (!setup_stack (esp))
     goto done;
@@ -508,75 +837,54 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
-  while (read_bytes > 0 || zero_bytes > 0) 
-    {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-			// vm_entry를 생성, 멤버변수(오프셋, 사이즈,...) 설정
-			struct vm_entry* vme = (struct vm_entry *)malloc(sizeof(struct vm_entry));
-			if(NULL == vme)
-				return false;
-			vme->type = VM_BIN;
-			vme->vaddr = upage;
-			vme->offset = ofs;
-			vme->read_bytes = page_read_bytes;
-			vme->zero_bytes = page_zero_bytes;
-			vme->writable = writable;
-			vme->is_loaded = false;
-			vme->file = file;
-			
-			// 생성한 vm_entry를 해시 테이블에 추가
-			if(!insert_vme(&thread_current()->vm, vme))
-				return false;
-
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-			ofs += page_read_bytes;
-      upage += PGSIZE;
-    }
+	// 세그먼트 전체를 영역 하나로 등록. 페이지별 vm_entry는 fault가 날 때
+	// find_vme에서 만든다
+	struct vm_area *vma = (struct vm_area *)malloc(sizeof(struct vm_area));
+	if(NULL == vma)
+		return false;
+	vma->type = VM_BIN;
+	vma->start = upage;
+	vma->end = upage + read_bytes + zero_bytes;
+	vma->writable = writable;
+	vma->file = file;
+	vma->offset = ofs;
+	vma->read_bytes = read_bytes;
+	vma->mmap_file = NULL;
+
+	// 다른 세그먼트와 겹치면 실패
+	if(!insert_vma(vma)) {
+		free(vma);
+		return false;
+	}
   return true;
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
    user virtual memory. */
+// 스택은 파일이 없는 영역 하나로만 등록하고 페이지는 미리 할당하지 않음.
+// argument_stack에서 처음 쓸 때 fault가 나면서 0으로 채운 페이지가 올라오고,
+// 그 아래로는 grow_stack이 영역을 stack_limit까지 늘려준다
 static bool
 setup_stack (void **esp) 
 {
-  uint8_t *kpage;
-  bool success = false;
-
-	struct page *page = alloc_page(PAL_USER | PAL_ZERO);
-	kpage = page->kaddr;
-  if (kpage != NULL) {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success) {
-        *esp = PHYS_BASE;
-				// vme만들고 초기화, 해시 테이블에 삽입
-				struct vm_entry *vme = (struct vm_entry *)
-															  malloc(sizeof(struct vm_entry));
-				if(vme == NULL)		// malloc 오류인 경우
-					return false;
-				// 아래는 초기화 후 삽입 부분
-				vme->type = VM_BIN;
-				vme->vaddr = ((uint8_t*)PHYS_BASE) - PGSIZE;
-				vme->writable = true;
-				vme->is_loaded = true;
-				insert_vme(&thread_current()->vm, vme);
-				page->vme = vme;
-			} // end of inner if
-      else
-				free_page(kpage);
-  } // end of outer if
-	//printf("in setup_stack....\n");
-	//print_lru_list();
+	struct vm_area *vma = (struct vm_area *)malloc(sizeof(struct vm_area));
+	if(NULL == vma)
+		return false;
+	vma->type = VM_BIN;
+	vma->start = ((uint8_t *) PHYS_BASE) - PGSIZE;
+	vma->end = PHYS_BASE;
+	vma->writable = true;
+	vma->file = NULL;
+	vma->offset = 0;
+	vma->read_bytes = 0;
+	vma->mmap_file = NULL;
+	if(!insert_vma(vma)) {
+		free(vma);
+		return false;
+	}
 
-  return success;
+	*esp = PHYS_BASE;
+  return true;
 }
 
 /* Adds a mapping from user virtual address UPAGE to kernel
@@ -600,123 +908,234 @@ install_page (void *upage, void *kpage, bool writable)
 }
 
 
+// 인자들을 유저 스택에 쌓음. 문자열을 뒤에서부터 한 번씩만 복사하고,
+// 복사한 위치는 PARSE에 덮어써서 argv를 만들 때 다시 씀
 void
 argument_stack(char **parse ,int count ,void **esp)
 {
-	int i = 0;				// for for loop;
-	// int j = 0;				// 한 글자씩 스택에 넣는 경우에 필요함.
-	void *top_of_command;
-	int *token_distance = palloc_get_page(PAL_ZERO);
-	int token_length_sum = -1; 		// 아래 token_distance에 값을 넣는 과정에서 사용됨.
-	
-	// memory allocation check
-	if(token_distance == NULL)
-    return TID_ERROR;
-
-	// token들의 길이 만큼 esp를 뒤로 옮김. +1하는 이유는 공백 저장을 위하여
-	// 그리고 token_distance도 값을 할당함. token_distance는 command의 시작부
-	// 터 각 토큰까지의 거리를 나타냄.
-	for(i = 0; i <count; i++) {
-		*esp -= strlen(parse[i]) + 1;
-		token_distance[i] = token_length_sum + 1;
-		token_length_sum += strlen(parse[i]) + 1;
-	}
-	
+	int i;				// for for loop;
+	char **argv;
 
-	// 아래는 한 단어씩 넣는 방법을 사용함. 
-  top_of_command = *esp;
-	for(i = 0; i < count; i++) {
-		strlcpy((char*)(*esp), parse[i], strlen(parse[i]) + 1);
-		*esp += strlen(parse[i]) + 1;			// considering '\0'
+	// 문자열들. 마지막 토큰부터 넣어야 argv[0]이 가장 아래에 옴
+	for(i = count - 1; i >= 0; i--) {
+		size_t len = strlen(parse[i]) + 1;			// considering '\0'
+		*esp -= len;
+		memcpy(*esp, parse[i], len);
+		parse[i] = *esp;
 	}
 
-	/*참고로 아래는 한 글자씩 넣는 방법을 사용함. 
-
-  top_of_command = *esp;
-	for(i = 0; i < count; i++) {
-		for(j = 0; j < strlen(token_array[i]); j++) {
-			*(char*)(*esp) = token_array[i][j];
-			*esp += 1;
-			printf("%c\n", token_array[i][j]);
-		}
-		*esp += 1;		// considering '\0'
-	}  */
-	
-
-	*esp = top_of_command;		// move esp back;
-
-	// from PHYS_BASE to esp, it should be multiple of 4 
-	if(0 != ((int)PHYS_BASE - (int)(*esp)) % 4)
-		*esp -= 4 - (((int)PHYS_BASE - (int)(*esp)) % 4);
+	// PHYS_BASE가 4의 배수이므로 esp를 4의 배수로 내림
+	*esp = (void *)((uintptr_t)*esp & ~(uintptr_t)3);
 
-	// insert null
-	*esp -= 4;
-	*(int*)(*esp) = 0;
+	// argv[argc]인 null
+	*esp -= sizeof(char *);
+	*(char **)(*esp) = NULL;
 
-	// save the address of arguments on the stack which were already pushed in the
-	// stack ex) in the case of 'echo x y z' (argv + 0) ~ (argv + 3)
+	// argv[i]
 	for(i = count - 1; i >= 0; i--) {
-		*esp -= 4;		// size of pointer is 4
-		*(char**)(*esp) = top_of_command + token_distance[i];
+		*esp -= sizeof(char *);
+		*(char **)(*esp) = parse[i];
 	}
+	argv = *esp;
 
 	// **argv
-  *esp -= 4;
-	*(char**)(*esp) = (*esp +4);
+	*esp -= sizeof(char **);
+	*(char ***)(*esp) = argv;
 
 	// argc
-	*esp -= 4;
-	*(int*)(*esp) = count;
+	*esp -= sizeof(int);
+	*(int *)(*esp) = count;
 
 	//insert fake address
-	*esp -= 4;
-	*(int*)(*esp) = 0;
+	*esp -= sizeof(void *);
+	*(void **)(*esp) = NULL;
+}
+
+
+// T의 fd 테이블을 최소 SIZE칸이 되도록 두 배씩 늘림. 처음 만들 때는 콘솔인
+// 0, 1번을 사용중으로 표시함. FDT_MAX를 넘거나 메모리가 없으면 false
+static bool fdt_grow(struct thread *t, int size) {
+	int new_size = 0 == t->fdt_size ? FDT_INIT_SIZE : t->fdt_size;
+	struct file **fdt;
+	struct bitmap *fd_map;
+	int i;
+
+	while(new_size < size)
+		new_size *= 2;
+	if(new_size > FDT_MAX)
+		return false;
+	if(new_size == t->fdt_size)
+		return true;
 
+	fdt = realloc(t->fdt, new_size * sizeof *fdt);
+	if(NULL == fdt)
+		return false;
+	t->fdt = fdt;
+	fd_map = bitmap_create(new_size);
+	if(NULL == fd_map)
+		return false;
 
-	// memory free
-	palloc_free_page(token_distance);
+	for(i = t->fdt_size; i < new_size; i++)
+		fdt[i] = NULL;
+	if(NULL == t->fd_map)
+		bitmap_set_multiple(fd_map, 0, 2, true);
+	else {
+		for(i = 0; i < t->fdt_size; i++)
+			bitmap_set(fd_map, i, bitmap_test(t->fd_map, i));
+		bitmap_destroy(t->fd_map);
+	}
+	t->fd_map = fd_map;
+	t->fdt_size = new_size;
+	return true;
 }
 
+// 비어있는 fd FD에 f를 넣음
+static void fdt_install(struct thread *t, int fd, struct file *f) {
+	t->fdt[fd] = f;
+	bitmap_mark(t->fd_map, fd);
+	if(fd == t->next_fd)
+		t->next_fd = fd + 1;
+}
 
 // 인자로 받은 f를 파일 디스크립터에 추가
-// 새로 추가된 f의 인덱스를 리턴.
+// 비어있는 가장 작은 fd를 쓰고 그 fd를 리턴. 테이블이 꽉 찼으면 -1
 int process_add_file(struct file *f) {
   struct thread *cur = thread_current ();
-	cur->fdt[cur->next_fd] = f;
-	cur->next_fd++;
+	size_t fd = BITMAP_ERROR;
+
+	// next_fd 아래는 모두 사용중이므로 거기서부터 찾음
+	if(NULL != cur->fd_map)
+		fd = bitmap_scan(cur->fd_map, cur->next_fd, 1, false);
+	if(BITMAP_ERROR == fd) {
+		fd = cur->fdt_size < cur->next_fd ? cur->next_fd : cur->fdt_size;
+		if(false == fdt_grow(cur, fd + 1))
+			return -1;
+	}
+	fdt_install(cur, fd, f);
 		
-	return cur->next_fd - 1;
+	return fd;
 }
 
 // fd번째 파일 객체의 주소를 리턴.
 // 없으면 NULL 반환.
 struct file *process_get_file(int fd) {
 	struct thread *cur = thread_current();
-	if(NULL == cur->fdt[fd] || fd >= cur->next_fd)
+	if(fd < 0 || fd >= cur->fdt_size)
 		return NULL;
 
 	return cur->fdt[fd];
 }
 
 // fd번째 파일 객체를 닫음.
-// fd번째는 NULL로 바꿈.
+// fd번째는 NULL로 바꾸고, 빈 칸이 되었으니 next_fd를 당겨옴
 void process_close_file(int fd) {
+	struct thread *cur = thread_current();
 	struct file *close_target = process_get_file(fd);
 	if(NULL != close_target) {
 		file_close(close_target);
-		thread_current()->fdt[fd] = NULL;
+		cur->fdt[fd] = NULL;
+		bitmap_reset(cur->fd_map, fd);
+		if(fd < cur->next_fd)
+			cur->next_fd = fd;
 	}
 }
 
-bool handle_mm_fault(struct vm_entry *vme) {
+// OLDFD와 같은 파일(위치도 공유)을 가리키는 새 fd를 만듦.
+// 비어있는 가장 작은 fd를 리턴, 실패시 -1
+int process_dup(int oldfd) {
+	struct file *f = process_get_file(oldfd);
+	int fd;
+
+	if(NULL == f)
+		return -1;
+	fd = process_add_file(file_dup(f));
+	if(-1 == fd)
+		file_close(f);
+	return fd;
+}
+
+// NEWFD가 OLDFD와 같은 파일을 가리키게 함. NEWFD가 열려있었으면 먼저 닫음.
+// NEWFD를 리턴, 실패시 -1. 콘솔(0, 1번)은 파일이 아니므로 대상이 될 수 없음
+int process_dup2(int oldfd, int newfd) {
+	struct thread *cur = thread_current();
+	struct file *f = process_get_file(oldfd);
+
+	if(NULL == f || newfd < 2)
+		return -1;
+	if(oldfd == newfd)
+		return newfd;
+	if(newfd >= cur->fdt_size && false == fdt_grow(cur, newfd + 1))
+		return -1;
+
+	process_close_file(newfd);
+	fdt_install(cur, newfd, file_dup(f));
+	return newfd;
+}
+
+// 열려있는 모든 fd를 닫고 fd 테이블을 해제
+void process_close_all_files(void) {
+	struct thread *cur = thread_current();
+	int fd;
+
+	for(fd = 2; fd < cur->fdt_size; fd++)
+		process_close_file(fd);
+	free(cur->fdt);
+	if(NULL != cur->fd_map)
+		bitmap_destroy(cur->fd_map);
+	cur->fdt = NULL;
+	cur->fd_map = NULL;
+	cur->fdt_size = 0;
+}
+
+// 읽기 전용 파일 페이지는 프로세스끼리 프레임을 공유할 수 있음
+static bool is_shareable(struct vm_entry *vme) {
+	return (VM_BIN == vme->type || VM_FILE == vme->type) && !vme->writable;
+}
+
+// 같은 파일 페이지를 다른 프로세스가 이미 읽어뒀으면 그 프레임을 맵핑.
+// 디스크를 읽지 않고 끝나면 true, 캐시에 없으면 false
+static bool map_cached_page(struct vm_entry *vme) {
+	struct page *page;
+	void *kaddr;
+
+	page = malloc(sizeof *page);
+	if(NULL == page)
+		return false;
+
+	lock_acquire(&lru_list_lock);
+	kaddr = page_cache_lookup(vme);
+	if(NULL == kaddr || false == install_page(vme->vaddr, kaddr, false)) {
+		lock_release(&lru_list_lock);
+		free(page);
+		return false;
+	}
+	frame_ref(kaddr);
+	page->kaddr = kaddr;
+	page->vme = vme;
+	page->thread = thread_current();
+	page->pinned = 0;
+	add_page_to_lru_list(page);
+	vme->page = page;
+	vme->is_loaded = true;
+	lock_release(&lru_list_lock);
+
+	return true;
+}
+
+// vme 하나를 물리 메모리에 올리고 맵핑. EVICT가 false면 남는 프레임이
+// 없을 때 다른 페이지를 쫓아내지 않고 실패함
+static bool load_page(struct vm_entry *vme, bool evict) {
+	// 공유 가능한 페이지면 페이지 캐시부터 찾아봄
+	if(is_shareable(vme) && map_cached_page(vme))
+		return true;
+
 	// 물리 메모리에 페이지 할당 후 실패시 false리턴
 	void* phys_addr;
-	struct page* page = alloc_page(PAL_USER);
-	phys_addr = page->kaddr;
+	struct page* page = evict ? alloc_page(PAL_USER) : try_alloc_page(PAL_USER);
 	bool success = false;
-	page->vme = vme;
-  if (NULL == phys_addr)
-    return false;
+	if(NULL == page)
+		return false;
+	phys_addr = page->kaddr;
 
 	switch (vme->type) {
 		// 물리 메모리에 로드
@@ -725,6 +1144,8 @@ bool handle_mm_fault(struct vm_entry *vme) {
 			success = load_file(phys_addr, vme);
 			break;
 		case VM_FILE :
+			// evict되면서 기록 중인 페이지면 다 기록할 때까지 기다림
+			writeback_wait(vme);
 			success = load_file(phys_addr, vme);
 			break;
 		case VM_ANON :
@@ -744,8 +1165,91 @@ bool handle_mm_fault(struct vm_entry *vme) {
 		free_page(phys_addr);
 		return false;
 	}
+	// 맵핑이 끝난 뒤에 vme를 연결해야 로드 중에 evict되지 않음
+	page->vme = vme;
+	vme->page = page;
 	vme->is_loaded = true;
 
+	// 4MB 영역이 모두 연속된 프레임으로 채워졌으면 큰 페이지 하나로 맵핑.
+	// 나중에 그 안의 페이지가 evict되면 pagedir에서 다시 쪼갠다
+	pagedir_promote(thread_current()->pagedir, vme->vaddr);
+
+	// 다른 프로세스가 같은 페이지를 찾을 수 있도록 캐시에 등록.
+	// 그 사이 evict되어 프레임이 해제됐을 수 있으니 맵핑을 다시 확인
+	if(is_shareable(vme)) {
+		lock_acquire(&lru_list_lock);
+		if(phys_addr == pagedir_get_page(thread_current()->pagedir, vme->vaddr))
+			page_cache_insert(phys_addr, vme);
+		lock_release(&lru_list_lock);
+	}
+
+	return true;
+}
+
+// fault-around. 파일에서 읽는 페이지가 fault나면 같은 맵핑에서 뒤따르는,
+// 아직 안 올라온 페이지들도 window만큼 같이 올려서 fault 횟수를 줄인다.
+// window는 지난번에 미리 올린 페이지들이 실제로 접근됐는지(accessed bit)를
+// 보고 늘이거나 줄임
+static void fault_around(struct vm_entry *vme) {
+	struct thread *t = thread_current();
+	struct vm_area *vma = find_vma(vme->vaddr);
+	struct vm_entry *prev = vme;
+	size_t i, hits = 0;
+
+	// 지난번 window의 적중률 계산. 3/4 이상이면 두 배, 1/4 미만이면 절반
+	for(i = 0; i < t->fa_cnt; i++)
+		if(pagedir_is_accessed(t->pagedir, t->fa_start + i * PGSIZE))
+			hits++;
+	if(t->fa_cnt > 0) {
+		if(hits * 4 >= t->fa_cnt * 3)
+			t->fa_window *= 2;
+		else if(hits * 4 < t->fa_cnt)
+			t->fa_window /= 2;
+	}
+	if(t->fa_window > fault_around_max)
+		t->fa_window = fault_around_max;
+	if(t->fa_window < 1)
+		t->fa_window = 1;
+
+	// 같은 영역에서 파일상으로 이어지는 이웃 페이지만 올림.
+	// 올라와 있는지는 pagedir로 먼저 보고, vm_entry는 실제로 올릴 페이지만
+	// 만듦. 안 올릴 이웃마다 만들면 영역 단위로 미뤄둔 의미가 없어짐
+	for(i = 0; i < t->fa_window && 0 < fault_around_max; i++) {
+		void *vaddr = vme->vaddr + (i + 1) * PGSIZE;
+		struct vm_entry *next;
+
+		if(NULL == vma || vaddr >= vma->end
+			 || NULL != pagedir_get_page(t->pagedir, vaddr))
+			break;
+		next = lookup_vme(vaddr);
+		if(NULL == next) {
+			// 아직 한 번도 접근하지 않은 페이지. 파일 내용이 끝난 뒤면 멈춤
+			if((size_t)((uint8_t *)vaddr - (uint8_t *)vma->start) >= vma->read_bytes
+				 || NULL == (next = find_vme(vaddr)))
+				break;
+		}
+		if(next->is_loaded || next->type != vme->type
+			 || next->file != vme->file
+			 || next->offset != prev->offset + prev->read_bytes)
+			break;
+		if(false == load_page(next, false))
+			break;
+		prev = next;
+	}
+	t->fa_start = vme->vaddr + PGSIZE;
+	t->fa_cnt = i;
+}
+
+bool handle_mm_fault(struct vm_entry *vme) {
+	// 로드하고 나면 type이 바뀔 수 있으니 미리 확인
+	// 스택처럼 파일이 없는 영역은 fault-around할 이유가 없음
+	bool from_file = (VM_BIN == vme->type || VM_FILE == vme->type)
+									 && NULL != vme->file;
+
+	if(false == load_page(vme, true))
+		return false;
+	if(from_file)
+		fault_around(vme);
 	return true;
 }
 
@@ -756,9 +1260,11 @@ bool load_file(void *kaddr, struct vm_entry *vme) {
 	// 그 결과는 kaddr(물리 페이지)에 저장된다.
 	// file_read_at의 리턴과 vme->read_bytes를 비교한다
 	// 그리고 아래는 좌 우가 unsigned, signed이므로 좌변을 (int)캐스팅
-	if((int)vme->read_bytes != file_read_at(vme->file, kaddr, 
+	// 실패시 kaddr의 해제는 호출한 쪽(handle_mm_fault)에서 free_page로 함
+	// bss나 스택처럼 읽을 게 없는 페이지는 파일이 없을 수도 있음
+	if(0 < vme->read_bytes
+		 && (int)vme->read_bytes != file_read_at(vme->file, kaddr, 
 																		 vme->read_bytes, vme->offset)) {
-		palloc_free_page(kaddr);
 		return false;
 	}
 	// 남는 부분은 0으로 채운다
@@ -766,3 +1272,59 @@ bool load_file(void *kaddr, struct vm_entry *vme) {
 
 	return true;
 }
+
+// 쓰기 금지된(COW로 공유중인) 페이지에 쓰기를 시도했을 때 불림.
+// 프레임을 혼자 쓰고 있으면 쓰기 권한만 돌려주고, 아니면 새 프레임에
+// 복사해서 나만의 페이지로 만든다.
+bool handle_cow_fault(struct vm_entry *vme) {
+	struct thread *t = thread_current();
+	struct page *page, *old_page;
+	void *old_kaddr;
+
+	if(false == vme->writable)
+		return false;
+
+	lock_acquire(&lru_list_lock);
+	old_kaddr = pagedir_get_page(t->pagedir, vme->vaddr);
+	// 그 사이에 evict됐으면 다시 fault가 나면서 로드됨
+	if(NULL == old_kaddr) {
+		lock_release(&lru_list_lock);
+		return true;
+	}
+	// 공유하던 쪽이 모두 떠났으면 복사할 필요 없음. 큰 페이지에 처음
+	// 쓴 경우도 여기로 옴. 쓰기 가능하게 바꾸면서 큰 페이지가 쪼개짐
+	if(1 == frame_ref_cnt(old_kaddr)) {
+		pagedir_set_writable(t->pagedir, vme->vaddr, true);
+		lock_release(&lru_list_lock);
+		return true;
+	}
+	lock_release(&lru_list_lock);
+
+	// 새 프레임 할당. 이 과정에서 eviction이 일어날 수 있음
+	page = alloc_page(PAL_USER);
+	if(NULL == page)
+		return false;
+
+	lock_acquire(&lru_list_lock);
+	old_page = vme->page;
+	if(NULL == old_page) {
+		// 할당하는 동안 원래 페이지가 evict됨. 새 프레임은 버린다
+		__free_page(page);
+		lock_release(&lru_list_lock);
+		return true;
+	}
+	memcpy(page->kaddr, old_page->kaddr, PGSIZE);
+	// 시스템 콜이 고정해둔 페이지일 수 있으므로 고정 횟수도 넘겨받음
+	page->pinned = old_page->pinned;
+	__free_page(old_page);					// 공유하던 프레임의 참조를 놓음
+	page->vme = vme;
+	vme->page = page;
+	if(false == install_page(vme->vaddr, page->kaddr, true)) {
+		__free_page(page);
+		lock_release(&lru_list_lock);
+		return false;
+	}
+	lock_release(&lru_list_lock);
+
+	return true;
+}
@@ -2,9 +2,11 @@
 #define USERPROG_PROCESS_H
 
 #include "threads/thread.h"
+#include "threads/interrupt.h"
 #include "vm/page.h"
 
 tid_t process_execute (const char *file_name);
+tid_t process_fork (struct intr_frame *f);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
@@ -13,5 +15,10 @@ void remove_child_process(struct thread *cp);
 int process_add_file(struct file *f);
 struct file *process_get_file(int fd);
 void process_close_file(int fd);
+int process_dup(int oldfd);
+int process_dup2(int oldfd, int newfd);
+void process_close_all_files(void);
+bool handle_mm_fault(struct vm_entry *vme);
+bool handle_cow_fault(struct vm_entry *vme);
 
 #endif /* userprog/process.h */
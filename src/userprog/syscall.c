@@ -2,9 +2,13 @@
 #include <stdio.h>
 #include <syscall-nr.h>
 #include <string.h>
+#include <round.h>
+#include <iovec.h>
 #include "threads/interrupt.h"
 #include "threads/vaddr.h"
+#include "threads/pte.h"
 #include "threads/thread.h"   // thread_exit()
+#include "threads/trace.h"
 #include "devices/shutdown.h" // shutdown_power_off()
 #include "devices/input.h"		// input_getc()
 #include "filesys/filesys.h"  // filesys_create(), remove()
@@ -14,7 +18,7 @@
 #include "vm/page.h"
 
 
-static void syscall_handler (struct intr_frame *f UNUSED);
+static void syscall_handler (struct intr_frame *f);
 
 
 // 아래는 구현한 시스템컬의 목록임.
@@ -34,17 +38,236 @@ void close(int fd);
 int mmap(int fd, void *addr);
 void munmap(int mapid);
 void do_munmap(struct mmap_file *mmp_f); 
+int readv(int fd, const struct iovec *iov, int iovcnt);
+int writev(int fd, const struct iovec *iov, int iovcnt);
+int pread(int fd, void *buffer, unsigned size, unsigned offset);
+int pwrite(int fd, void *buffer, unsigned size, unsigned offset);
+int copy_file_range(int fd_in, int fd_out, unsigned len);
+int dup(int oldfd);
+int dup2(int oldfd, int newfd);
+void *sbrk(intptr_t increment);
+static void check_buffer(void *buffer, unsigned size);
+static void pin_iovec(const struct iovec *iov, int iovcnt, void *esp);
+static void unpin_iovec(const struct iovec *iov, int iovcnt);
+static int do_rw(int fd, const struct iovec *iov, int iovcnt, off_t ofs,
+								 bool to_write);
+
+// 한 번에 고정하는 유저 메모리의 최대 크기. 버퍼 전체를 미리 고정하면
+// 유저 프레임보다 큰 버퍼(sbrk로 쉽게 만듦)에서는 evict할 페이지가 남지
+// 않으므로, 버퍼는 이만큼씩 고정해서 읽거나 쓰고 풀어줌
+#define PIN_CHUNK (16 * PGSIZE)
+
+// 시스템 콜 인자의 종류. 포인터 인자는 핸들러를 부르기 전에
+// syscall_handler에서 한 번에 검사함
+#define ARG_VAL 0				// 그냥 값
+#define ARG_STR 1				// 널 문자로 끝나는 문자열
+#define ARG_BUF_IN 2		// 바로 다음 인자가 크기인 버퍼. 커널이 읽기만 함
+#define ARG_BUF_OUT 3		// 바로 다음 인자가 크기인 버퍼. 커널이 씀
+#define ARG_IOV_IN 4		// 바로 다음 인자가 개수인 iovec 배열. 커널이 읽기만 함
+#define ARG_IOV_OUT 5		// 바로 다음 인자가 개수인 iovec 배열. 커널이 씀
+
+// 인자는 유저 스택에 있는 것을 복사하지 않고 ARG로 바로 넘김.
+// 리턴값은 f->eax에 들어감
+typedef uint32_t syscall_func (uint32_t *arg, struct intr_frame *f);
+
+struct syscall_desc {
+	syscall_func *func;							// 핸들러
+	int argc;												// 인자 수. 최대 4개
+	uint8_t arg_type[4];						// 각 인자의 종류 (ARG_*)
+};
+
+// 아래는 인자를 풀어서 각 시스템 콜에 넘겨주는 핸들러들
+static uint32_t
+sys_halt (uint32_t *arg UNUSED, struct intr_frame *f UNUSED)
+{
+	TRACE_END(TRACE_SYSCALL, SYS_HALT, 0);
+	halt();
+	NOT_REACHED();
+}
+
+static uint32_t
+sys_exit (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	TRACE_END(TRACE_SYSCALL, SYS_EXIT, arg[0]);
+	exit(arg[0]);
+	NOT_REACHED();
+}
+
+static uint32_t
+sys_exec (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return exec((const char *)arg[0]);
+}
+
+static uint32_t
+sys_wait (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return wait((tid_t)arg[0]);
+}
+
+static uint32_t
+sys_create (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return create((const char *)arg[0], arg[1]);
+}
+
+static uint32_t
+sys_remove (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return remove((const char *)arg[0]);
+}
+
+static uint32_t
+sys_open (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return open((const char *)arg[0]);
+}
+
+static uint32_t
+sys_filesize (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return filesize(arg[0]);
+}
+
+static uint32_t
+sys_read (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return read(arg[0], (void *)arg[1], arg[2]);
+}
+
+static uint32_t
+sys_write (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return write(arg[0], (void *)arg[1], arg[2]);
+}
+
+static uint32_t
+sys_seek (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	seek(arg[0], arg[1]);
+	return 0;
+}
+
+static uint32_t
+sys_tell (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return tell(arg[0]);
+}
+
+static uint32_t
+sys_close (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	close(arg[0]);
+	return 0;
+}
+
+static uint32_t
+sys_mmap (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return mmap(arg[0], (void *)arg[1]);
+}
+
+static uint32_t
+sys_munmap (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	munmap(arg[0]);
+	return 0;
+}
+
+// 부모에게는 자식의 tid, 자식에게는 0을 리턴(start_fork 참조)
+static uint32_t
+sys_fork (uint32_t *arg UNUSED, struct intr_frame *f)
+{
+	return process_fork(f);
+}
+
+static uint32_t
+sys_readv (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return readv(arg[0], (const struct iovec *)arg[1], arg[2]);
+}
+
+static uint32_t
+sys_writev (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return writev(arg[0], (const struct iovec *)arg[1], arg[2]);
+}
+
+static uint32_t
+sys_pread (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return pread(arg[0], (void *)arg[1], arg[2], arg[3]);
+}
+
+static uint32_t
+sys_pwrite (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return pwrite(arg[0], (void *)arg[1], arg[2], arg[3]);
+}
+
+static uint32_t
+sys_copy_file_range (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return copy_file_range(arg[0], arg[1], arg[2]);
+}
+
+static uint32_t
+sys_dup (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return dup(arg[0]);
+}
+
+static uint32_t
+sys_dup2 (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return dup2(arg[0], arg[1]);
+}
+
+static uint32_t
+sys_sbrk (uint32_t *arg, struct intr_frame *f UNUSED)
+{
+	return (uint32_t) sbrk(arg[0]);
+}
+
+// 시스템 콜 번호로 찾는 핸들러 테이블. 비어있는 번호는 func가 NULL
+static const struct syscall_desc syscall_table[] = {
+	[SYS_HALT]     = { sys_halt,     0, { ARG_VAL } },
+	[SYS_EXIT]     = { sys_exit,     1, { ARG_VAL } },
+	[SYS_EXEC]     = { sys_exec,     1, { ARG_STR } },
+	[SYS_WAIT]     = { sys_wait,     1, { ARG_VAL } },
+	[SYS_CREATE]   = { sys_create,   2, { ARG_STR, ARG_VAL } },
+	[SYS_REMOVE]   = { sys_remove,   1, { ARG_STR } },
+	[SYS_OPEN]     = { sys_open,     1, { ARG_STR } },
+	[SYS_FILESIZE] = { sys_filesize, 1, { ARG_VAL } },
+	[SYS_READ]     = { sys_read,     3, { ARG_VAL, ARG_BUF_OUT, ARG_VAL } },
+	[SYS_WRITE]    = { sys_write,    3, { ARG_VAL, ARG_BUF_IN, ARG_VAL } },
+	[SYS_SEEK]     = { sys_seek,     2, { ARG_VAL, ARG_VAL } },
+	[SYS_TELL]     = { sys_tell,     1, { ARG_VAL } },
+	[SYS_CLOSE]    = { sys_close,    1, { ARG_VAL } },
+	[SYS_MMAP]     = { sys_mmap,     2, { ARG_VAL, ARG_VAL } },
+	[SYS_MUNMAP]   = { sys_munmap,   1, { ARG_VAL } },
+	[SYS_FORK]     = { sys_fork,     0, { ARG_VAL } },
+	[SYS_READV]    = { sys_readv,    3, { ARG_VAL, ARG_IOV_OUT, ARG_VAL } },
+	[SYS_WRITEV]   = { sys_writev,   3, { ARG_VAL, ARG_IOV_IN, ARG_VAL } },
+	[SYS_PREAD]    = { sys_pread,    4, { ARG_VAL, ARG_BUF_OUT, ARG_VAL, ARG_VAL } },
+	[SYS_PWRITE]   = { sys_pwrite,   4, { ARG_VAL, ARG_BUF_IN, ARG_VAL, ARG_VAL } },
+	[SYS_COPY_FILE_RANGE] = { sys_copy_file_range, 3,
+	                          { ARG_VAL, ARG_VAL, ARG_VAL } },
+	[SYS_DUP]      = { sys_dup,      1, { ARG_VAL } },
+	[SYS_DUP2]     = { sys_dup2,     2, { ARG_VAL, ARG_VAL } },
+	[SYS_SBRK]     = { sys_sbrk,     1, { ARG_VAL } },
+};
+
+#define SYSCALL_CNT (sizeof syscall_table / sizeof *syscall_table)
 
 void
 syscall_init (void) 
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
-	// lock 초기화
-	lock_init(&filesys_lock);
 }
 
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+syscall_handler (struct intr_frame *f) 
 {
 	/* 
 	 유저 스택에 저장되어 있는 시스템 콜 넘버를 이용해 시스템 콜 핸들러 구현
@@ -52,140 +275,61 @@ syscall_handler (struct intr_frame *f UNUSED)
 	 저장된 인자 값이 포인터일 경우 유저 영역의 주소인지 확인
 	*/
 	uint32_t *esp = f->esp;		// esp 복사
-	int sys_n = *(int *)(f->esp); 	  // system call number. esp가 가리키는 곳에 있음.
-	int arg[4];						// 인자를 넣을 배열. 최대 인자 갯수는 4개임.
-
-	check_address(esp, esp);
-
-	/*  ****************************************************************
-		아래는 시스템컬 핸들러 테이블 없이 시스템컬 넘버에 따라 알맞은 시스템
-		콜을 불러오는 코드입니다.
-		어떤 시스템컬이 호출되었는지 잘 알 수 있도록 printf구문을 모든 case의 
-		시작에 넣었습니다.
-		대부분 메커니즘은 비슷합니다. 
-		check_address는 인자로 넘어온 포인터의 주소값이 유효한지 검사하며,
-		시스템컬에 리턴값이 있다면 그 리턴값은 f->eax에 넣어줍니다.
-		 **************************************************************** */
-	switch(sys_n)
-	{
-		case SYS_HALT :                   /* Halt the operating system. */
-			{
-				//printf("halt() called\n");
-				halt();
-			}
-		case SYS_EXIT :                  /* Terminate this process. */
-			{
-				//printf("exit() called\n");
-				get_argument(esp, arg, 1);
-				exit(arg[0]);
-				break;
-			}
-		case SYS_EXEC :                  /* Start another process. */
-			{
-				//printf("exec() called\n");
-				get_argument(esp, arg, 1);
-				//아래는 주석처리됨
-				//check_address((void *)arg[0]);		// arg[0]이 유효한 주소영역인지 검사.
-				check_valid_string((void *)arg[0], esp);
-				f->eax = exec((const char *)arg[0]);
-				break;
-			}
-		case SYS_WAIT :                  /* Wait for a child process to die. */
-			{
-				//printf("wait() called\n");
-				get_argument(esp, arg, 1);
-				f->eax = wait((tid_t)arg[0]);
-				break;
-			}
-		case SYS_CREATE :                /* Create a file. */
-			{
-				//printf("create() called\n");
-				get_argument(esp, arg, 2);
-				//check_address((void *)arg[0]);		// arg[0]이 유효한 주소영역인지 검사.
-				check_valid_string((void *)arg[0], esp);
-				f->eax = create((const char *)arg[0], arg[1]);
-				break;
-			}
-		case SYS_REMOVE :                /* Delete a file. */
-			{
-				//printf("remove() called\n");
-				get_argument(esp, arg, 1);
-				//check_address((void *)arg[0]);	//  arg[0]이 유효한 주소영역인지 검사.
-				check_valid_string((void *)arg[0], esp);
-				f->eax = remove((const char *)arg[0]);
-				break;
-			}
-     case SYS_OPEN :                 /* Open a file. */
-			{
-				//printf("open() called\n");
-				get_argument(esp, arg, 1);
-				//check_address((void *)arg[0]);
-				check_valid_string((void *)arg[0], esp);
-				f->eax = open((const char *)arg[0]);
-				break;
-			}
-     case SYS_FILESIZE :             /* Obtain a file's size. */
-			{
-				//printf("filesize() called\n");
-				get_argument(esp, arg, 1);
-				f->eax  = filesize(arg[0]);
-				break;
-			}
-     case SYS_READ :                 /* Read from a file. */
-			{
-				//printf("read() called\n");
-				get_argument(esp, arg, 3);
-				//check_address((void *)arg[1]);  아래 함수로 대체
-				check_valid_buffer((void *)arg[1], arg[2], esp, true); 
-				f->eax = read(arg[0], (void *)arg[1], arg[2]);
-				break;
-			}
-     case SYS_WRITE :                /* Write to a file. */
-			{
-				//printf("write() called\n");
-				get_argument(esp, arg, 3);
-				//check_address((void *)arg[1]);
-				check_valid_buffer((void *)arg[1], arg[2], esp, false); 
-				f->eax = write(arg[0], (void *)arg[1], arg[2]);
-				break;
-			}
-     case SYS_SEEK :                 /* Change position in a file. */
-			{
-				//printf("seek() called\n");
-				get_argument(esp, arg, 2);
-				seek(arg[0], arg[1]);
+	uint32_t *arg = esp + 1;	// 인자들은 시스템 콜 넘버 바로 위에 있음
+	const struct syscall_desc *desc;
+	unsigned sys_n;
+	int i;
+
+	// 커널에서 유저 스택을 건드리다 fault가 나면 유저 esp가 필요함
+	thread_current()->esp = f->esp;
+
+	// 시스템 콜 넘버와 인자들이 놓인 범위는 길어야 두 페이지에 걸치므로
+	// 처음과 끝만 검사하면 됨
+	if(NULL == check_address(esp, esp)
+		 || NULL == check_address((uint8_t *)(esp + 1) - 1, esp))
+		exit(-1);
+	sys_n = *esp;
+	if(sys_n >= SYSCALL_CNT || NULL == syscall_table[sys_n].func)
+		exit(-1);
+	desc = &syscall_table[sys_n];
+	if(0 < desc->argc && NULL == check_address((uint8_t *)(arg + desc->argc) - 1,
+																						 esp))
+		exit(-1);
+
+	// 포인터 인자 검사. 문자열과 iovec 배열은 시스템 콜이 끝날 때까지 evict되지
+	// 않게 고정. 버퍼는 범위만 보고, do_rw가 PIN_CHUNK씩 고정하면서 씀
+	for(i = 0; i < desc->argc; i++) {
+		switch(desc->arg_type[i]) {
+			case ARG_STR :
+				pin_string((void *)arg[i], esp);
 				break;
-			}
-     case SYS_TELL :                 /* Report current position in a file. */
-			{
-				//printf("tell() called\n");
-				get_argument(esp, arg, 1);
-				f->eax = tell(arg[0]); 
+			case ARG_BUF_IN :
+			case ARG_BUF_OUT :
+				check_buffer((void *)arg[i], arg[i + 1]);
 				break;
-			}
-     case SYS_CLOSE :                /* Close a file. */
-			{
-				//printf("close() called\n");
-				get_argument(esp, arg, 1);
-				close(arg[0]);
+			case ARG_IOV_IN :
+			case ARG_IOV_OUT :
+				pin_iovec((const struct iovec *)arg[i], arg[i + 1], esp);
 				break;
-			}
-		 case SYS_MMAP :
-			{
-				get_argument(esp, arg, 2);
-				f->eax = mmap(arg[0], (void *)arg[1]);
+		}
+	}
+
+	// 인자 검사에서 exit하면 짝이 없는 BEGIN이 남으므로 검사가 끝난 뒤에 기록
+	TRACE_BEGIN(TRACE_SYSCALL, sys_n, 0);
+	f->eax = desc->func(arg, f);
+
+	for(i = 0; i < desc->argc; i++) {
+		switch(desc->arg_type[i]) {
+			case ARG_STR :
+				unpin_string((void *)arg[i]);
 				break;
-			}
-		 case SYS_MUNMAP :
-			{
-				get_argument(esp, arg, 1);
-				munmap(arg[0]);
+			case ARG_IOV_IN :
+			case ARG_IOV_OUT :
+				unpin_iovec((const struct iovec *)arg[i], arg[i + 1]);
 				break;
-			}
+		}
 	}
-
-//  printf ("system call!\n");
-//  thread_exit ();
+	TRACE_END(TRACE_SYSCALL, sys_n, f->eax);
 }
 
 /* addr이 유효한 주소인지 확인.0x804800에서 0x0000000사이이면 유저영역임.
@@ -194,41 +338,17 @@ syscall_handler (struct intr_frame *f UNUSED)
  아래 함수를 사용가능. */
 // + vm_entry를 리턴하도록 변경됨.
  
-struct vm_entry *check_address(void *addr, void* esp /*Unused*/) 
+struct vm_entry *check_address(void *addr, void* esp) 
 {
+	struct vm_entry *vme;
 	if((uint32_t)addr < 0x8048000 || (uint32_t)addr >= 0xc0000000) 
 		exit(-1);
 
-	return find_vme(addr);
-}
-
-
-// 유저 스택에 저장된 인자값들을 arg에 복사.
-// 참고로 핀토스 시스템콜의 최대 인자 수는 3개. read, write의 인자가 3개이다.
-// 그러므로, count가 3보다 작거나 같다고  생각하고 만듬.
-void 
-get_argument(void *esp, int *arg, int count)
-{
-	int i;		// for loop;
-	// 스택에 있는 인자들을 가리킴. 현재 esp는 system call number이므로
-	// +4을 해서 다음 주소를 가리키게 한다.
-	/* *****************************************
-		 잠깐 여기서 팁
-		 void *는 다음 주소를 +4하는 이유는 우리가 int배열인 arg를 가리키
-		 게 하고 싶기 때문이다. 만약 여기서 그냥 +4대신 ++해버리면 이상해진다
-		 *********************************************************** */
-	void *ptr = esp + 4;		
-	
-	ASSERT(count >= 0 && count <= 3);   // count의 범위를 확인.
-
-	// 유저 스택에 저장된 인자값들을 커널에 복사
-	// 인자가 저장된 위치가 유저영역인지 확인
-	for(i = 0; i < count; i++) {
-		check_address(ptr, ptr);
-		arg[i] = *(int *)(ptr);   
-		//printf("arg[%d] = %d\n", i, arg[i]);
-		ptr += 4;
-	}
+	vme = find_vme(addr);
+	// 어느 영역에도 없지만 스택 바로 아래라면 스택을 늘림
+	if(NULL == vme && grow_stack(addr, esp))
+		vme = find_vme(addr);
+	return vme;
 }
 
 
@@ -246,6 +366,9 @@ exit(int status)
 {
 	struct thread *cur = thread_current();
 	cur->exit_status = status;
+	// 시스템 콜이나 page fault 도중에 죽으면 END가 기록되지 않으므로
+	// 디코더가 열린 구간을 여기서 닫음
+	TRACE_INSTANT(TRACE_EXIT, status, 0);
 	printf ("%s: exit(%d)\n", cur->name, status);
 	thread_exit();
 }
@@ -293,19 +416,18 @@ open(const char *file) {
 	// open_target은 file이라는 이름으로 열고 싶은 파일
 	struct file *open_target;
 	int result;
-	lock_acquire(&filesys_lock);
 	open_target = filesys_open(file);
 
 	// 실패시 -1리턴
-	if(NULL == open_target) {
-		lock_release(&filesys_lock);
+	if(NULL == open_target)
 		return -1;
-	}
 
+	// 오픈 성공했으면 open_target을 fdt에 넣고 그 인덱스 리턴
+	// fd 테이블이 꽉 찼으면 닫고 -1
 	result = process_add_file(open_target);
-	lock_release(&filesys_lock);
+	if(-1 == result)
+		file_close(open_target);
 		
-	// 오픈 성공했으면 open_target을 fdt에 넣고 그 인덱스 리턴
 	return result;
 }
 
@@ -324,77 +446,19 @@ filesize(int fd) {
 }
 
 // fd번째 파일객체를 열어서 buffer에 size만큼 저장함.
+// fd가 0이면 키보드에서 읽음. 읽어들인 바이트 수를 리턴, 실패시 -1
 int
 read(int fd, void *buffer, unsigned size) {
-
-	struct file *read_target;		// read할 파일 객체
-	off_t bytes_read;						// 읽어들인 바이트 수.
-	unsigned i;											// 반복제어변수
-	
-	lock_acquire(&filesys_lock);	// 동시 접근을 막기 위해 lock사용
-
-	// fd가 1이거나 0보다 작으면 헛소리이기 때문에 -1반환
-	if(1 == fd || fd < 0) {
-		lock_release(&filesys_lock);
-		return -1;
-	}
-
-	// fd가 0이면 키보드의 입력을 받는다. 일반적 경우와 달리 처리해주어야함.
-	// 여기서는 input_getc함수를 사용합니다.
-	if(STDIN_FILENO == fd) {
-		for(i = 0; i < size; i++) {
-			((char *)buffer)[i] = input_getc();
-		}
-		
-		lock_release(&filesys_lock);
-		return i;			// i번 만큼 읽었기 때문에 i를 리턴
-	}
-	// fd가 0, 1모두 아니면 파일객체 탐색 후 실패했으면 -1리턴
-	read_target = process_get_file(fd);
-	if(NULL == read_target) {
-		lock_release(&filesys_lock);
-		return -1;
-	}
-
-	// 성공했으면 file_read를 이용해 파일을 읽고, 읽은 바이트 수를 리턴
-	bytes_read = file_read(read_target, buffer, size);
-	lock_release(&filesys_lock);
-	return bytes_read;
+	struct iovec iov = { buffer, size };
+	return do_rw(fd, &iov, 1, -1, false);
 }
 
+// buffer의 size바이트를 fd번째 파일에 기록. fd가 1이면 모니터에 출력함.
+// 기록한 바이트 수를 리턴, 실패시 -1
 int
 write(int fd, void *buffer, unsigned size) {
-
-	struct file *write_target;		// write할 파일 객체
-	off_t bytes_written;						// 기록한 바이트 수.
-	
-	lock_acquire(&filesys_lock);	// 동시 접근을 막기 위해 lock사용
-
-	// fd가 0보다 작거나 같으면면 헛소리이기 때문에 -1반환
-	if(0 >= fd) {
-		lock_release(&filesys_lock);
-		return -1;
-	}
-
-	// fd가 1이면 모니터에 출력한다. 일반적 경우와 달리 처리해주어야함.
-	// 여기서는 putbuf함수를 사용합니다.
-	if(STDOUT_FILENO == fd) {
-		putbuf (buffer, size); 
-		lock_release(&filesys_lock);
-		return size;
-	}
-
-	// 0, 1모두 아니면 파일객체 탐색 후 실패했으면 -1리턴
-	write_target = process_get_file(fd);
-	if(NULL == write_target) {
-		lock_release(&filesys_lock);
-		return -1;
-	}
-
-	// 성공했으면 file_write를 이용해 파일에 기록하고, 기록한 바이트 수를 리턴
-	bytes_written = file_write(write_target, buffer, size);
-	lock_release(&filesys_lock);
-	return bytes_written;
+	struct iovec iov = { buffer, size };
+	return do_rw(fd, &iov, 1, -1, true);
 }
 
 // fd번째 파일객체의 offset을 position으로 이동.
@@ -425,38 +489,116 @@ close(int fd) {
 	process_close_file(fd);
 }
 
-// 인자로 받은 buffer의 주소가 유효한지 검사
-void check_valid_buffer(void *buffer, unsigned size, void *esp, bool to_write) {
-	struct vm_entry *vme;
-	unsigned i;		// for loop을 위해. size가 unsigned이므로 그에 맞게 자료형 설정
-	void *addr = buffer;
+// ADDR이 속한 유저 페이지를 물리 메모리에 올리고 고정함.
+// 시스템 콜을 처리하는 동안(inode의 lock을 잡고 있는 동안에도) page fault가
+// 나지 않게 하기 위함. 잘못된 주소거나 쓰기 금지된 곳에 쓰려고 하면
+// 프로세스를 종료시킴. TO_WRITE면 COW로 공유중인 페이지는 미리 복사해둠
+static void pin_page(void *addr, void *esp, bool to_write) {
+	struct vm_entry *vme = check_address(addr, esp);
+	if(NULL == vme || (to_write && false == vme->writable))
+		exit(-1);
 
-	// check_address로 주소 유효성 검사. 쓰기 가능 여부 판단
-	for(i = 0; i < size; i++) {
-		vme = check_address(addr, esp);
+	// 올리고 나서 고정하기 전에 evict될 수 있으므로 고정될 때까지 반복
+	do {
+		if(false == vme->is_loaded && false == handle_mm_fault(vme))
+			exit(-1);
+		if(to_write && false == handle_cow_fault(vme))
+			exit(-1);
+	} while(false == set_page_pinned(addr, true));
+}
 
-		if(NULL != vme && to_write) 
-			if(false == vme->writable)
-				exit(-1);
+// BUFFER부터 SIZE바이트가 유저 영역 안에 있는지 검사. 끝이 주소 공간을 넘어
+// 한 바퀴 돌거나 커널 영역에 걸치면 페이지를 고정하는 루프가 아예 돌지
+// 않거나 커널 주소를 고정하게 되므로 먼저 걸러냄. 잘못됐으면 프로세스 종료
+static void check_buffer(void *buffer, unsigned size) {
+	uint8_t *start = buffer;
 
-		addr++;
+	if(0 < size
+		 && (start + size < start || false == is_user_vaddr(start + size - 1)))
+		exit(-1);
+}
+
+// BUFFER부터 SIZE바이트를 덮는 유저 페이지들을 페이지마다 한 번씩 고정함.
+// 한꺼번에 PIN_CHUNK보다 많이 고정하면 evict할 페이지가 모자랄 수 있음
+void pin_buffer(void *buffer, unsigned size, void *esp, bool to_write) {
+	uint8_t *start = buffer;
+	uint8_t *upage;
+
+	if(0 == size)
+		return;
+	check_buffer(buffer, size);
+	for(upage = pg_round_down(start); upage < start + size; upage += PGSIZE)
+		pin_page(upage < start ? start : upage, esp, to_write);
+}
+
+// pin_buffer로 고정한 페이지들을 풀어줌
+void unpin_buffer(void *buffer, unsigned size) {
+	void *upage;
+
+	if(0 == size)
+		return;
+	for(upage = pg_round_down(buffer); upage < buffer + size; upage += PGSIZE)
+		set_page_pinned(upage, false);
+}
+
+// iovec 배열 IOV를 고정하고 그 안의 버퍼들의 범위를 검사. 개수가 잘못됐으면
+// 아무것도 하지 않고, 시스템 콜 쪽에서 -1을 리턴함. 배열은 IOV_MAX개로
+// 제한되므로 통째로 고정해도 몇 페이지 안 됨. 배열을 먼저 고정하므로 iov를
+// 읽어도 fault가 안 남. 버퍼는 do_rw가 PIN_CHUNK씩 고정함
+static void pin_iovec(const struct iovec *iov, int iovcnt, void *esp) {
+	int i;
+
+	if(iovcnt < 0 || iovcnt > IOV_MAX)
+		return;
+	pin_buffer((void *)iov, iovcnt * sizeof *iov, esp, false);
+	for(i = 0; i < iovcnt; i++)
+		check_buffer(iov[i].iov_base, iov[i].iov_len);
+}
+
+// pin_iovec으로 고정한 배열을 풀어줌
+static void unpin_iovec(const struct iovec *iov, int iovcnt) {
+	if(iovcnt < 0 || iovcnt > IOV_MAX)
+		return;
+	unpin_buffer((void *)iov, iovcnt * sizeof *iov);
+}
+
+// str이 걸친 페이지들을 페이지마다 한 번씩 검사하고 고정함. 페이지 안에서는
+// 널 문자만 찾으면 됨. filesys_open 등이 dir_lock이나 inode의 lock을 잡은
+// 채로 이름을 읽다가 fault가 나지 않게 하기 위함.
+// 문자열은 나눠서 고정할 수 없으므로 PIN_CHUNK 안에서 끝나지 않으면 프로세스
+// 종료. 파일 이름과 exec의 명령줄은 그보다 훨씬 짧아야 쓸모가 있음
+void pin_string(const void *str, void *esp) {
+	const char *p = str;
+	const char *limit = (const char *)pg_round_down(str) + PIN_CHUNK;
+
+	while(true) {
+		const char *end = (const char *)pg_round_down(p) + PGSIZE;
+		if(end > limit)
+			exit(-1);
+		pin_page((void *)p, esp, false);
+		for(; p < end; p++)
+			if('\0' == *p)
+				return;
 	}
-}	
-
-// str의 모든 문자 하나하나에 대해서 주소 검사를 함
-void check_valid_string(const void *str, void *esp) {
-	check_address((void *)str, esp);
-	// 널 문자를 만날 때까지 검사
-	while(*(char *)str != '\0') {
-		str += 1;
-		check_address((void *)str, esp);
+}
+
+// pin_string으로 고정한 페이지들을 풀어줌
+void unpin_string(const void *str) {
+	const char *p = str;
+
+	while(true) {
+		const char *end = (const char *)pg_round_down(p) + PGSIZE;
+		set_page_pinned((void *)p, false);
+		for(; p < end; p++)
+			if('\0' == *p)
+				return;
 	}
 }
 
 
 int mmap(int fd, void *addr) {
 	struct mmap_file *mmp_f;
-	size_t offset = 0;						// addr(file의 시작주소)로 부터의 offset
+	struct vm_area *vma;
 	static int new_mapid = 0;			// mapid를 위한 변수
 	// addr의 4KB allign여부를 검사. pg_ofs가 0이면 페이지의 시작이므로
 	// 4KB의 시작이라는 뜻
@@ -472,49 +614,47 @@ int mmap(int fd, void *addr) {
 	mmp_f = (struct mmap_file *)malloc(sizeof(struct mmap_file));
 	if(NULL == mmp_f)
 		return -1;			// 본 함수에서의 에러코드는 -1
+	vma = (struct vm_area *)malloc(sizeof(struct vm_area));
+	if(NULL == vma) {
+		free(mmp_f);
+		return -1;
+	}
 
 	// 아래는 생성 후 초기화하는 과정임
 	memset(mmp_f, 0, sizeof(struct mmap_file));
 	list_init(&mmp_f->vme_list);
 	mmp_f->file = file_reopen(process_get_file(fd));
 	// fd번째 file을 reopen하는 과정에서 에러가 생겼으면 -1
-	if(NULL == mmp_f->file)
+	if(NULL == mmp_f->file) {
+		free(vma);
+		free(mmp_f);
+		return -1;
+	}
+
+	// 파일 전체를 영역 하나로 맵핑. 페이지별 vm_entry는 접근할 때 만들어짐
+	vma->type = VM_FILE;
+	vma->start = addr;
+	vma->read_bytes = file_length(mmp_f->file);
+	vma->end = addr + ROUND_UP(vma->read_bytes, PGSIZE);
+	vma->writable = true;
+	vma->file = mmp_f->file;
+	vma->offset = 0;
+	vma->mmap_file = mmp_f;
+	mmp_f->vma = vma;
+
+	// 빈 파일이거나, 커널 영역을 넘거나, 다른 영역과 겹치면 -1
+	if(false == is_user_vaddr(vma->end - 1) || false == insert_vma(vma)) {
+		file_close(mmp_f->file);
+		free(vma);
+		free(mmp_f);
 		return -1;
+	}
+
 	//mapid 부여
 	mmp_f->mapid = new_mapid++;
 	// 현재 스레드의 mmap_list에 삽입
 	list_push_back(&thread_current()->mmap_list, &mmp_f->elem);
 
-	// 아래는 vme를 생성하고 초기화하는 과정임
-	// load_segment()에서 따옴
-	// 우선 디스크의 file의 길이를 얻어서 그 길이만큼 돌며 vme를 생성
-	int mmp_f_length = file_length(mmp_f->file);
-	while (mmp_f_length > 0) {
-		if(find_vme(addr))		// 이미 존재하면 -1
-			return -1;
-
-		// vm_entry를 생성, 멤버변수(오프셋, 사이즈,...) 설정
-		struct vm_entry* vme = (struct vm_entry *)malloc(sizeof(struct vm_entry));
-		vme->type = VM_FILE;
-		vme->vaddr = addr;
-		vme->offset = offset;
-		vme->read_bytes = mmp_f_length < PGSIZE ? mmp_f_length : PGSIZE;	// 최대 PGSIZE
-		vme->zero_bytes = PGSIZE - vme->read_bytes;
-		vme->writable = true;
-		vme->file = mmp_f->file;
-		vme->is_loaded = false;
-
-		// 생성한 vm_entry를 해시 테이블에 추가
-		insert_vme(&thread_current()->vm, vme);
-		// mmap_file list의 원소로 추가
-		list_push_back(&mmp_f->vme_list, &vme->mmap_elem);
-
-		// while 문을 위한 변수들 업데이트, 한 페이지 단위로 맵핑하기 때문에 아래와 같다
-		mmp_f_length -= PGSIZE;
-		addr += PGSIZE;
-		offset += PGSIZE;
-	}
-
 	return mmp_f->mapid;
 }
 
@@ -559,24 +699,237 @@ void munmap(int mapid) {
 void do_munmap(struct mmap_file *mmp_f) {
 	struct list_elem *e;
 	struct thread *t = thread_current();
+	struct vm_area *vma = mmp_f->vma;
+	uint32_t *bits = NULL;
+
+	// 영역 전체의 dirty bit를 한 번에 읽어둠. 어차피 맵핑을 끊으므로
+	// 지우지는 않음(그 사이 evict되는 페이지도 dirty를 보고 기록하도록).
+	// 메모리가 없으면 페이지마다 읽음
+	if(NULL != vma)
+		bits = malloc((vma->end - vma->start) / PGSIZE * sizeof *bits);
+	if(NULL != bits)
+		pagedir_scan_range(t->pagedir, vma->start, vma->end, 0, bits);
+
 	// e = list_next(e)를 안하는 이유는 for loop 내부에서 list_remove를 하기 때문
 	for(e = list_begin(&mmp_f->vme_list); e != list_end(&mmp_f->vme_list); ) {
 		struct vm_entry *vme = list_entry(e, struct vm_entry, mmap_elem);
 		if(vme->is_loaded) {
-			// dirty면 file 동기화
-			if(pagedir_is_dirty(t->pagedir, vme->vaddr)) {
-				lock_acquire(&filesys_lock);
-				file_write_at(vme->file, vme->vaddr, vme->read_bytes, vme->offset);
-				lock_release(&filesys_lock);
-			}
+			void *kaddr = pagedir_get_page(t->pagedir, vme->vaddr);
+			bool dirty = NULL != bits
+				? (bits[(vme->vaddr - vma->start) / PGSIZE] & PTE_D) != 0
+				: pagedir_is_dirty(t->pagedir, vme->vaddr);
+			// dirty면 file 동기화. 유저 주소는 pin되어 있지 않아서 기록 중에
+			// fault가 날 수 있으므로 커널 주소로 기록함
+			if(dirty)
+				file_write_at(vme->file, kaddr, vme->read_bytes, vme->offset);
 			// page 해제
-			free_page(pagedir_get_page(t->pagedir, vme->vaddr));
+			free_page(kaddr);
 			pagedir_clear_page(t->pagedir, vme->vaddr);
 		} // end of outer if
 		e = list_remove(e);
 		delete_vme(&t->vm, vme);
 		free(vme);
 	} // end of for....
+	free(bits);
+	// 영역도 삭제
+	if(NULL != mmp_f->vma) {
+		delete_vma(mmp_f->vma);
+		free(mmp_f->vma);
+	}
 }
 
+// fd번째 파일과 IOV의 버퍼들 사이에서 읽거나(TO_WRITE가 false) 씀.
+// OFS가 -1이면 파일의 현재 위치부터 하고 끝난 뒤 위치를 한 번만 옮기며,
+// 아니면 OFS부터 하고 위치는 건드리지 않음. fd가 0이나 1이면 콘솔과 주고받음.
+// 버퍼는 PIN_CHUNK씩 고정하고 읽거나 쓴 다음 풀어줌.
+// 처리한 바이트 수를 리턴, 실패시 -1
+static int
+do_rw(int fd, const struct iovec *iov, int iovcnt, off_t ofs, bool to_write) {
+	void *esp = thread_current()->esp;
+	struct file *target = NULL;
+	bool console;
+	off_t pos = 0;
+	int total = 0;
+	int i;
+
+	if(iovcnt < 0 || iovcnt > IOV_MAX)
+		return -1;
+
+	// 콘솔은 위치가 없으므로 현재 위치를 쓰는 경우만 허용
+	console = (STDIN_FILENO == fd && !to_write) || (STDOUT_FILENO == fd && to_write);
+	if(console) {
+		if(-1 != ofs)
+			return -1;
+	}
+	else {
+		target = fd < 2 ? NULL : process_get_file(fd);
+		if(NULL == target)
+			return -1;
+		pos = -1 == ofs ? file_tell(target) : ofs;
+	}
+
+	for(i = 0; i < iovcnt; i++) {
+		uint8_t *buf = iov[i].iov_base;
+		size_t left = iov[i].iov_len;
+
+		while(0 < left) {
+			// 고정하는 범위가 PIN_CHUNK를 넘지 않도록 페이지 경계에서 자름
+			size_t chunk = PIN_CHUNK - pg_ofs(buf);
+			off_t cnt;
+
+			if(chunk > left)
+				chunk = left;
+			pin_buffer(buf, chunk, esp, !to_write);
+			if(console) {
+				size_t j;
+				if(to_write)
+					putbuf((const char *)buf, chunk);
+				else
+					for(j = 0; j < chunk; j++)
+						buf[j] = input_getc();
+				cnt = chunk;
+			}
+			else if(to_write)
+				cnt = file_write_at(target, buf, chunk, pos);
+			else
+				cnt = file_read_at(target, buf, chunk, pos);
+			unpin_buffer(buf, chunk);
+
+			total += cnt;
+			pos += cnt;
+			// 파일 끝에 닿았거나 더 쓸 수 없으면 멈춤
+			if((size_t)cnt < chunk)
+				goto done;
+			buf += cnt;
+			left -= cnt;
+		}
+	}
+done:
+	if(NULL != target && -1 == ofs)
+		file_seek(target, pos);
 
+	return total;
+}
+
+int
+readv(int fd, const struct iovec *iov, int iovcnt) {
+	return do_rw(fd, iov, iovcnt, -1, false);
+}
+
+int
+writev(int fd, const struct iovec *iov, int iovcnt) {
+	return do_rw(fd, iov, iovcnt, -1, true);
+}
+
+// 파일의 현재 위치와 상관없이 offset부터 읽음
+int
+pread(int fd, void *buffer, unsigned size, unsigned offset) {
+	struct iovec iov = { buffer, size };
+	if((off_t)offset < 0)
+		return -1;
+	return do_rw(fd, &iov, 1, offset, false);
+}
+
+// 파일의 현재 위치와 상관없이 offset부터 기록
+int
+pwrite(int fd, void *buffer, unsigned size, unsigned offset) {
+	struct iovec iov = { buffer, size };
+	if((off_t)offset < 0)
+		return -1;
+	return do_rw(fd, &iov, 1, offset, true);
+}
+
+// fd_in의 현재 위치부터 len 바이트를 fd_out의 현재 위치로 복사하고 두
+// 파일의 위치를 옮김. 데이터는 버퍼 캐시 안에서만 옮겨지고 유저 메모리를
+// 거치지 않음. 복사한 바이트 수를 리턴, 실패시 -1
+int
+copy_file_range(int fd_in, int fd_out, unsigned len) {
+	struct file *in, *out;
+	int copied;
+
+	if((off_t)len < 0)
+		return -1;
+
+	// 콘솔은 버퍼 캐시에 없으므로 지원하지 않음
+	in = fd_in < 2 ? NULL : process_get_file(fd_in);
+	out = fd_out < 2 ? NULL : process_get_file(fd_out);
+	if(NULL == in || NULL == out)
+		return -1;
+
+	// 같은 파일 안에서 겹치는 범위끼리는 복사하지 않음
+	if(file_get_inode(in) == file_get_inode(out)) {
+		off_t in_pos = file_tell(in), out_pos = file_tell(out);
+		if(in_pos < out_pos + (off_t)len && out_pos < in_pos + (off_t)len)
+			return -1;
+	}
+
+	copied = file_copy(in, out, len);
+
+	return copied;
+}
+
+// oldfd와 같은 파일을 가리키는 새 fd를 만듦. 두 fd는 파일 위치를 공유함
+// 비어있는 가장 작은 fd를 리턴, 실패시 -1
+int
+dup(int oldfd) {
+	return oldfd < 2 ? -1 : process_dup(oldfd);
+}
+
+// newfd가 oldfd와 같은 파일을 가리키게 함. newfd가 열려있었으면 먼저 닫음
+// newfd를 리턴, 실패시 -1
+int
+dup2(int oldfd, int newfd) {
+	return oldfd < 2 ? -1 : process_dup2(oldfd, newfd);
+}
+
+// 힙의 끝을 INCREMENT 바이트만큼 옮기고 이전 끝을 리턴. 실패시 (void *) -1
+// 힙은 파일이 없는 영역 하나로, 스택처럼 페이지는 처음 접근할 때 0으로
+// 채워서 올라온다. 스택이 stack_limit까지 자랄 자리는 남겨둔다
+void *
+sbrk(intptr_t increment) {
+	struct thread *t = thread_current();
+	uint8_t *start = t->heap_start;
+	uint8_t *old = t->brk;
+	uint8_t *brk = old + increment;
+	uint8_t *end = pg_round_up(brk);
+	struct vm_area *heap;
+
+	if(NULL == start
+		 || (0 <= increment ? brk < old : brk > old)
+		 || brk < start || brk > (uint8_t *)PHYS_BASE - stack_limit)
+		return (void *) -1;
+	if(end == pg_round_up(old)) {
+		t->brk = brk;
+		return old;
+	}
+
+	// 힙이 비어있었으면 영역을 새로 만듦
+	heap = (uint8_t *)pg_round_up(old) > start ? find_vma(start) : NULL;
+	if(NULL == heap) {
+		heap = malloc(sizeof *heap);
+		if(NULL == heap)
+			return (void *) -1;
+		heap->type = VM_BIN;
+		heap->start = start;
+		heap->end = end;
+		heap->writable = true;
+		heap->file = NULL;
+		heap->offset = 0;
+		heap->read_bytes = 0;
+		heap->mmap_file = NULL;
+		if(!insert_vma(heap)) {
+			free(heap);
+			return (void *) -1;
+		}
+	}
+	else if(!resize_vma(heap, end))
+		return (void *) -1;
+	// 힙을 모두 반납했으면 영역도 지움
+	else if(end == start) {
+		delete_vma(heap);
+		free(heap);
+	}
+
+	t->brk = brk;
+	return old;
+}
@@ -1,12 +1,164 @@
 // frame.c
 #include "vm/frame.h"
+#include "filesys/inode.h"
+#include "threads/loader.h"
+#include "threads/pte.h"
+#include "threads/trace.h"
 
 static struct list_elem *get_next_lru_clock(void);
+static struct frame *kaddr_to_frame(void *kaddr);
+static void *frame_to_kaddr(struct frame *f);
+static unsigned page_cache_hash_func(const struct hash_elem *e, void *aux);
+static bool page_cache_less_func(const struct hash_elem *a,
+																 const struct hash_elem *b, void *aux);
+
+// 물리 페이지 번호로 인덱싱하는 프레임 테이블
+static struct frame *frame_table;
+
+// 페이지 캐시. 읽기 전용 파일 페이지를 (inode, offset)으로 찾아서
+// 여러 프로세스가 같은 프레임을 맵핑할 수 있게 함
+static struct hash page_cache;
+
+// 기록 중인 struct writeback들과, 하나가 끝날 때마다 알리는 condition.
+// 둘 다 lru_list_lock으로 보호
+static struct list writeback_list;
+static struct condition writeback_done;
 
 void lru_list_init(void) {						// lru_list, lru_list_lock, lru_clock초기화
 	list_init(&lru_list);
 	lock_init(&lru_list_lock);
 	lru_clock = NULL;
+	// 물리 메모리 전체 페이지 수만큼 프레임 테이블을 만든다
+	frame_table = calloc(init_ram_pages, sizeof *frame_table);
+	ASSERT(NULL != frame_table);
+	hash_init(&page_cache, page_cache_hash_func, page_cache_less_func, NULL);
+	list_init(&writeback_list);
+	cond_init(&writeback_done);
+}
+
+// kaddr(커널 가상 주소)에 해당하는 프레임 테이블의 원소
+static struct frame *kaddr_to_frame(void *kaddr) {
+	uintptr_t pfn = vtop(kaddr) >> PGBITS;
+	ASSERT(pfn < init_ram_pages);
+	return &frame_table[pfn];
+}
+
+// 아래 세 함수는 lru_list_lock을 잡은 상태에서 호출해야 함
+void frame_ref(void *kaddr) {
+	kaddr_to_frame(kaddr)->ref_cnt++;
+}
+
+int frame_unref(void *kaddr) {
+	struct frame *f = kaddr_to_frame(kaddr);
+	ASSERT(f->ref_cnt > 0);
+	// 마지막 맵핑이 사라지면 프레임이 해제되므로 캐시에서도 뺀다
+	if(0 == --f->ref_cnt && NULL != f->inode) {
+		hash_delete(&page_cache, &f->elem);
+		f->inode = NULL;
+	}
+	return f->ref_cnt;
+}
+
+int frame_ref_cnt(void *kaddr) {
+	return kaddr_to_frame(kaddr)->ref_cnt;
+}
+
+// 프레임 테이블의 원소 f에 해당하는 kaddr
+static void *frame_to_kaddr(struct frame *f) {
+	return ptov((uintptr_t)(f - frame_table) << PGBITS);
+}
+
+static unsigned page_cache_hash_func(const struct hash_elem *e,
+																		 void *aux UNUSED) {
+	struct frame *f = hash_entry(e, struct frame, elem);
+	return hash_bytes(&f->inode, sizeof f->inode) ^ hash_int(f->offset);
+}
+
+static bool page_cache_less_func(const struct hash_elem *a_,
+																 const struct hash_elem *b_, void *aux UNUSED) {
+	struct frame *a = hash_entry(a_, struct frame, elem);
+	struct frame *b = hash_entry(b_, struct frame, elem);
+	if(a->inode != b->inode)
+		return a->inode < b->inode;
+	if(a->offset != b->offset)
+		return a->offset < b->offset;
+	return a->read_bytes < b->read_bytes;
+}
+
+// vme가 가리키는 파일 페이지를 이미 읽어둔 프레임이 있으면 그 kaddr,
+// 없으면 NULL을 리턴. lru_list_lock을 잡은 상태에서 호출
+void *page_cache_lookup(struct vm_entry *vme) {
+	struct frame key;
+	struct hash_elem *e;
+
+	key.inode = file_get_inode(vme->file);
+	key.offset = vme->offset;
+	key.read_bytes = vme->read_bytes;
+	e = hash_find(&page_cache, &key.elem);
+	if(NULL == e)
+		return NULL;
+	return frame_to_kaddr(hash_entry(e, struct frame, elem));
+}
+
+// vme의 내용을 읽어둔 프레임 kaddr을 페이지 캐시에 등록.
+// 같은 페이지가 이미 등록되어 있으면(동시에 로드한 경우) 그냥 둔다.
+// lru_list_lock을 잡은 상태에서 호출
+void page_cache_insert(void *kaddr, struct vm_entry *vme) {
+	struct frame *f = kaddr_to_frame(kaddr);
+
+	ASSERT(NULL == f->inode);
+	f->inode = file_get_inode(vme->file);
+	f->offset = vme->offset;
+	f->read_bytes = vme->read_bytes;
+	if(NULL != hash_insert(&page_cache, &f->elem))
+		f->inode = NULL;
+}
+
+// 커널 주소 KADDR에 있는 VME의 내용을 파일에 기록할 준비. 프레임을 참조하고
+// 파일을 다시 열어두므로, 그 뒤에 page를 해제하거나 프로세스가 파일을 닫아도
+// writeback_finish에서 기록할 수 있음. lru_list_lock을 잡은 상태에서 호출
+void writeback_start(struct writeback *wb, struct vm_entry *vme, void *kaddr) {
+	wb->inode = inode_reopen(file_get_inode(vme->file));
+	wb->offset = vme->offset;
+	wb->bytes = vme->read_bytes;
+	wb->kaddr = kaddr;
+	frame_ref(kaddr);
+	list_push_back(&writeback_list, &wb->elem);
+}
+
+// writeback_start로 준비한 WB를 기록하고, 마지막 참조였으면 프레임을 해제.
+// lru_list_lock을 잡은 상태에서 호출하지만, 기록하는 동안은 lock을 놓으므로
+// 다른 fault나 evict가 이 파일의 I/O를 기다리지 않음. 리턴할 때는 다시 잡고
+// 있지만 그 사이 lru_list는 바뀌었을 수 있음
+void writeback_finish(struct writeback *wb) {
+	lock_release(&lru_list_lock);
+	inode_write_at(wb->inode, wb->kaddr, wb->bytes, wb->offset);
+	inode_close(wb->inode);
+	lock_acquire(&lru_list_lock);
+
+	list_remove(&wb->elem);
+	if(0 == frame_unref(wb->kaddr))
+		palloc_free_page(wb->kaddr);
+	cond_broadcast(&writeback_done, &lru_list_lock);
+}
+
+// VME의 파일 페이지를 기록 중이면 끝날 때까지 기다림. 파일에서 읽어오기 전에
+// 불러야 방금 evict된 내용을 옛 내용으로 덮어쓰지 않음
+void writeback_wait(struct vm_entry *vme) {
+	struct inode *inode = file_get_inode(vme->file);
+	struct list_elem *e;
+
+	lock_acquire(&lru_list_lock);
+	for(e = list_begin(&writeback_list); e != list_end(&writeback_list); ) {
+		struct writeback *wb = list_entry(e, struct writeback, elem);
+		if(inode == wb->inode && (off_t)vme->offset == wb->offset) {
+			cond_wait(&writeback_done, &lru_list_lock);
+			e = list_begin(&writeback_list);
+		}
+		else
+			e = list_next(e);
+	}
+	lock_release(&lru_list_lock);
 }
 
 // page를 lru뒤에 삽입
@@ -60,36 +212,58 @@ static struct list_elem *get_next_lru_clock(void) {
 	return lru_clock;
 }
 
-// lru_list를 돌며 accessed bit 가 0인 친구를 페이지 해제
+// lru_list를 돌며 accessed bit 가 0인 친구를 페이지 해제.
+// 모든 page가 고정됐거나 다른 프로세스와 공유중이면 해제할 page가 없으므로
+// 두 바퀴만 돌고 NULL을 리턴. 첫 바퀴에서 accessed bit를 지우므로 해제할 수
+// 있는 page가 있으면 두 바퀴 안에 찾음
 void *try_to_free_pages(enum palloc_flags flag) {
-	void *kaddr;			// return용
+	void *kaddr = NULL;			// return용
+	struct pagedir_batch batch;
+	struct writeback wb;
+	bool writing = false;		// wb를 기록해야 하는지
+	size_t budget;					// 남은 검사 횟수
 	lock_acquire(&lru_list_lock);
+	// accessed bit를 지울 때마다 TLB를 비우지 않고, 다 돌고 나서 한 번에 비움
+	pagedir_batch_begin(&batch);
 
+	budget = 2 * list_size(&lru_list);
 	lru_clock = list_begin(&lru_list);
-	while(true) {
+	while(0 < budget-- && NULL != lru_clock) {
 		struct page *page = list_entry(lru_clock, struct page, lru);
+		uint32_t bits;
 		lru_clock = get_next_lru_clock();
+
+		// 아직 vme가 연결되지 않은(로드 중인) 페이지와 시스템 콜이
+		// 사용중인 페이지는 건너뜀
+		if(NULL == page->vme || page->pinned)
+			continue;
 	
-		// accessed bit 가 1이면 0으로 바꿈
-		if(pagedir_is_accessed(page->thread->pagedir, page->vme->vaddr)) {
-			pagedir_set_accessed(page->thread->pagedir, page->vme->vaddr, false);
-		}
-		// 0이면 해제
-		else {
+		// accessed, dirty bit를 한 번에 읽고 accessed bit는 0으로 바꿈
+		pagedir_scan_range(page->thread->pagedir, page->vme->vaddr,
+											 page->vme->vaddr + PGSIZE, PTE_A, &bits);
+		// accessed bit가 0이었으면 해제
+		if(0 == (bits & PTE_A)) {
+			TRACE_BEGIN(TRACE_EVICT, page->vme->vaddr, page->thread->tid);
 			//해제 시 타입별로 다름
 			switch(page->vme->type) {
 				// type을 anon으로 바꿈 그리고 swap out
+				// 읽기 전용이면 바뀐 내용이 없으므로 다시 파일에서 읽으면 됨.
+				// 다른 프로세스와 공유중인 프레임이면 이 맵핑만 끊기고, 모든
+				// 맵핑이 접근되지 않아서 끊겨야 프레임이 실제로 해제됨
 				case VM_BIN :								
-					page->vme->type = VM_ANON;
-					page->vme->swap_slot = swap_out(page->kaddr);
+					if(page->vme->writable) {
+						page->vme->type = VM_ANON;
+						page->vme->swap_slot = swap_out(page->kaddr);
+					}
 					break;
 				// type을 바꾸지는 않음. dirty만 보고서 file에 기록 or not
 				case VM_FILE :
-					if(pagedir_is_dirty(page->thread->pagedir, page->vme->vaddr)) {
-						lock_acquire(&filesys_lock);
-						file_write_at(page->vme->file, page->vme->vaddr,
-													page->vme->read_bytes, page->vme->offset);
-						lock_release(&filesys_lock);
+					// 기록은 page를 떼어낸 뒤 lru_list_lock을 놓고 함. 프레임은
+					// 기록이 끝날 때까지 참조해 둠. page->thread는 보통 현재
+					// 스레드가 아니므로 유저 주소가 아닌 커널 주소로 기록해야 함
+					if(bits & PTE_D) {
+						writeback_start(&wb, page->vme, page->kaddr);
+						writing = true;
 					}
 					break;
 				// bin과 같음
@@ -99,28 +273,45 @@ void *try_to_free_pages(enum palloc_flags flag) {
 					break;
 			}
 			page->vme->is_loaded = false;
+			// 하나 남은 page였으면 시계바늘이 해제할 page를 가리키고 있음
+			if(&page->lru == lru_clock)
+				lru_clock = NULL;
 			__free_page(page);
+			if(writing) {
+				writing = false;
+				pagedir_batch_end(&batch);
+				writeback_finish(&wb);
+				pagedir_batch_begin(&batch);
+				// lock을 놓은 사이 lru_list가 바뀌었으므로 처음부터 다시 셈
+				budget = 2 * list_size(&lru_list);
+				lru_clock = list_begin(&lru_list);
+			}
+			TRACE_END(TRACE_EVICT, 0, 0);
 
 			kaddr = palloc_get_page(flag);
 			if(kaddr)
 				break;
 		} // end of else
 	} // end of while
+	pagedir_batch_end(&batch);
 	lock_release(&lru_list_lock);
 
 	return kaddr;
 }
 
+// tid 스레드의 모든 page를 해제. 공유중인 프레임은 참조 횟수만 줄어듦
 void free_all_pages(tid_t tid) {
 	struct list_elem *elem, *tmp;
 	struct page *page;
+	lock_acquire(&lru_list_lock);
 	for(elem = list_begin(&lru_list); elem != list_end(&lru_list); ) {
 		tmp = list_next(elem);
 		page = list_entry(elem, struct page, lru);
 		if(page->thread->tid == tid) {
-			del_page_from_lru_list(page);
+			__free_page(page);
 		}
 		elem = tmp;
 	}
+	lock_release(&lru_list_lock);
 }
 
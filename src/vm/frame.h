@@ -8,6 +8,30 @@
 #include <debug.h>
 #include <list.h>
 
+// 물리 프레임 하나당 하나씩 존재. 같은 프레임을 여러 page(맵핑)가
+// 공유할 수 있으므로(fork의 copy-on-write, 읽기 전용 코드 페이지)
+// 참조 횟수를 센다.
+struct frame {
+	int ref_cnt;									// 이 프레임을 맵핑하고 있는 page의 수
+	// 아래는 페이지 캐시에 들어있는 프레임에서만 사용
+	struct inode *inode;					// 프레임에 읽어둔 파일. 캐시에 없으면 NULL
+	off_t offset;									// 파일 오프셋
+	size_t read_bytes;						// 파일에서 읽은 바이트 수
+	struct hash_elem elem;				// page_cache의 원소
+};
+
+// 파일에 기록 중인 페이지 하나. evict나 fork처럼 lru_list_lock을 잡고 고른
+// 페이지를, 그 lock을 놓고 기록하기 위함. 기록이 끝나기 전에 같은 파일
+// 페이지를 다시 읽으면 옛 내용을 읽게 되므로 load_page는 writeback_wait로
+// 기다린다
+struct writeback {
+	struct inode *inode;					// 기록할 파일. 기록하는 동안 닫히지 않게 다시 엶
+	off_t offset;									// 파일 오프셋
+	size_t bytes;									// 기록할 바이트 수
+	void *kaddr;									// 기록할 내용이 있는 프레임. 참조해 둠
+	struct list_elem elem;				// writeback_list의 원소
+};
+
 void lru_list_init(void);
 void add_page_to_lru_list(struct page *page);
 void del_page_from_lru_list(struct page *page);
@@ -17,6 +41,14 @@ struct list lru_list;							// page를 관리하는 list
 struct lock lru_list_lock;				// lru_list를 위한 lock
 struct list_elem *lru_clock;			// lru_list의 elem을 가리키는 포인터
 void free_all_pages(tid_t tid);
+void frame_ref(void *kaddr);						// 참조 횟수 1 증가
+int frame_unref(void *kaddr);						// 참조 횟수 1 감소. 남은 횟수 리턴
+int frame_ref_cnt(void *kaddr);					// 현재 참조 횟수
+void *page_cache_lookup(struct vm_entry *vme);
+void page_cache_insert(void *kaddr, struct vm_entry *vme);
+void writeback_start(struct writeback *wb, struct vm_entry *vme, void *kaddr);
+void writeback_finish(struct writeback *wb);
+void writeback_wait(struct vm_entry *vme);
 
 
 
@@ -1,6 +1,12 @@
 // page.c
 #include "page.h"
 #include "frame.h"
+#include <string.h>
+
+// fault-around로 한 번에 같이 로드할 최대 이웃 페이지 수. -fa 옵션으로 조절
+size_t fault_around_max = 16;
+// 유저 스택이 늘어날 수 있는 최대 크기. -sl 옵션으로 조절
+size_t stack_limit = 8 * 1024 * 1024;
 
 static unsigned vm_hash_func (const struct hash_elem *e, void *aux) {
 	// hash_elem인 e를 이용해 vm_entry를 찾고, 해당 vm_entry의 가상
@@ -49,18 +55,211 @@ bool delete_vme(struct hash *vm, struct vm_entry *vme) {
 	return false;
 }
 
+// 영역 VMA 안의 페이지 VADDR에 대한 vm_entry를 만들어서 해시 테이블에 추가
+static struct vm_entry *vma_create_vme(struct vm_area *vma, void *vaddr) {
+	size_t pos = vaddr - vma->start;		// 영역 시작으로부터의 거리
+	struct vm_entry *vme = (struct vm_entry *)malloc(sizeof(struct vm_entry));
+	if(NULL == vme)
+		return NULL;
+
+	vme->type = vma->type;
+	vme->vaddr = vaddr;
+	vme->writable = vma->writable;
+	vme->is_loaded = false;
+	vme->page = NULL;
+	vme->file = vma->file;
+	// 파일 내용이 끝난 뒤의 페이지는 0으로만 채움
+	if(pos < vma->read_bytes) {
+		vme->offset = vma->offset + pos;
+		vme->read_bytes = vma->read_bytes - pos < PGSIZE ?
+											vma->read_bytes - pos : PGSIZE;
+	}
+	else {
+		vme->offset = vma->offset + vma->read_bytes;
+		vme->read_bytes = 0;
+	}
+	vme->zero_bytes = PGSIZE - vme->read_bytes;
+
+	insert_vme(&thread_current()->vm, vme);
+	// mmap 영역이면 munmap에서 찾을 수 있게 mmap_file에도 연결
+	if(NULL != vma->mmap_file)
+		list_push_back(&vma->mmap_file->vme_list, &vme->mmap_elem);
+	return vme;
+}
+
 struct vm_entry *find_vme(void *vaddr) {
+	struct vm_entry *vme = lookup_vme(vaddr);
+	struct vm_area *vma;
+
+	if(NULL != vme)
+		return vme;
+
+	// 아직 접근한 적 없는 페이지면 영역을 보고 vm_entry를 만든다
+	// 영역에도 없으면 NULL리턴
+	vma = find_vma(pg_round_down(vaddr));
+	if(NULL == vma)
+		return NULL;
+	return vma_create_vme(vma, pg_round_down(vaddr));
+}
+
+// find_vme와 같지만 이미 만들어진 vm_entry만 찾음. 없으면 NULL
+struct vm_entry *lookup_vme(void *vaddr) {
 	struct hash_elem *elem;
 	struct vm_entry vme;
 
 	vme.vaddr = pg_round_down(vaddr);		// 인자 vaddr에서 vpn을 추출  
 
 	elem = hash_find(&thread_current()->vm, &vme.elem);
-	// 못찾았으면 NULL리턴
-	if(NULL == elem)
+	return NULL != elem ? hash_entry(elem, struct vm_entry, elem) : NULL;
+}
+
+// 영역 배열에서 start가 VADDR보다 큰 첫 영역의 인덱스 (이진 탐색)
+static size_t vma_upper_bound(struct thread *t, void *vaddr) {
+	size_t lo = 0, hi = t->vma_cnt;
+	while(lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if(t->vma[mid]->start <= vaddr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// 현재 스레드의 영역 배열에 VMA를 추가. 비어있거나 다른 영역과 겹치면 false
+bool insert_vma(struct vm_area *vma) {
+	struct thread *t = thread_current();
+	size_t i = vma_upper_bound(t, vma->start);
+
+	if(vma->start >= vma->end)
+		return false;
+	// 앞, 뒤 영역과 겹치는지 확인. 정렬되어 있으므로 둘만 보면 됨
+	if(0 < i && t->vma[i - 1]->end > vma->start)
+		return false;
+	if(i < t->vma_cnt && t->vma[i]->start < vma->end)
+		return false;
+
+	// 배열이 꽉 찼으면 두 배로 늘림
+	if(t->vma_cnt == t->vma_cap) {
+		size_t cap = 0 == t->vma_cap ? 8 : t->vma_cap * 2;
+		struct vm_area **vmas = realloc(t->vma, cap * sizeof *vmas);
+		if(NULL == vmas)
+			return false;
+		t->vma = vmas;
+		t->vma_cap = cap;
+	}
+	memmove(t->vma + i + 1, t->vma + i, (t->vma_cnt - i) * sizeof *t->vma);
+	t->vma[i] = vma;
+	t->vma_cnt++;
+	return true;
+}
+
+// 영역 배열에서 VMA를 뺌. 해제는 호출한 쪽에서 함
+bool delete_vma(struct vm_area *vma) {
+	struct thread *t = thread_current();
+	size_t i = vma_upper_bound(t, vma->start);
+
+	if(0 == i || vma != t->vma[i - 1])
+		return false;
+	i--;
+	memmove(t->vma + i, t->vma + i + 1,
+					(t->vma_cnt - i - 1) * sizeof *t->vma);
+	t->vma_cnt--;
+	return true;
+}
+
+// VADDR을 포함하는 영역을 찾음. 없으면 NULL
+struct vm_area *find_vma(void *vaddr) {
+	struct thread *t = thread_current();
+	size_t i = vma_upper_bound(t, vaddr);
+
+	if(0 == i || t->vma[i - 1]->end <= vaddr)
 		return NULL;
-	
-	return hash_entry(elem, struct vm_entry, elem);
+	return t->vma[i - 1];
+}
+
+// 페이지 UPAGE의 vm_entry가 있으면 올라와 있는 프레임이나 스왑 슬롯과
+// 함께 해제. 해제하는 동안 evict되지 않도록 lru_list_lock을 잡음
+static void unmap_vme(void *upage) {
+	struct thread *t = thread_current();
+	struct hash_elem *elem;
+	struct vm_entry key, *vme;
+
+	key.vaddr = upage;
+	elem = hash_find(&t->vm, &key.elem);
+	if(NULL == elem)
+		return;
+	vme = hash_entry(elem, struct vm_entry, elem);
+
+	lock_acquire(&lru_list_lock);
+	if(vme->is_loaded) {
+		if(NULL != vme->page)
+			__free_page(vme->page);
+	}
+	else if(VM_ANON == vme->type)
+		swap_free(vme->swap_slot);
+	lock_release(&lru_list_lock);
+
+	delete_vme(&t->vm, vme);
+	free(vme);
+}
+
+// 영역 VMA의 끝을 END로 옮김. 늘릴 때는 다음 영역과 겹치면 실패하고,
+// 줄일 때는 잘려나간 페이지들을 해제함. END가 start와 같으면 영역이
+// 비게 되므로 호출한 쪽에서 delete_vma로 지워야 함
+bool resize_vma(struct vm_area *vma, void *end) {
+	struct thread *t = thread_current();
+	size_t i = vma_upper_bound(t, vma->start);
+	void *upage;
+
+	ASSERT(0 < i && vma == t->vma[i - 1]);
+	ASSERT(pg_ofs(end) == 0 && end >= vma->start);
+
+	if(end > vma->end) {
+		if(i < t->vma_cnt && t->vma[i]->start < end)
+			return false;
+	}
+	else {
+		for(upage = end; upage < vma->end; upage += PGSIZE)
+			unmap_vme(upage);
+	}
+	vma->end = end;
+	return true;
+}
+
+// 스택 영역 바로 아래에 접근한 경우 스택 영역을 ADDR까지 늘림.
+// 스택 영역은 항상 PHYS_BASE에서 끝나므로 start만 내리면 되고, 늘어난
+// 부분의 페이지는 다른 영역처럼 접근할 때 만들어짐
+bool grow_stack(void *addr, void *esp) {
+	struct thread *t = thread_current();
+	struct vm_area *stack = find_vma((uint8_t *)PHYS_BASE - 1);
+	void *start = pg_round_down(addr);
+	size_t i;
+
+	// PUSHA는 esp보다 32바이트 아래까지 먼저 씀. 그보다 아래는 잘못된 접근
+	if(NULL == stack || addr < esp - 32 || addr >= stack->start)
+		return false;
+	if((size_t)((uint8_t *)PHYS_BASE - (uint8_t *)start) > stack_limit)
+		return false;
+
+	// 바로 아래 영역과 겹치면 안됨. 스택 영역은 배열의 마지막 원소
+	i = t->vma_cnt - 1;
+	if(0 < i && t->vma[i - 1]->end > start)
+		return false;
+	stack->start = start;
+	return true;
+}
+
+// 현재 스레드의 모든 영역을 해제
+void vma_destroy(void) {
+	struct thread *t = thread_current();
+	size_t i;
+
+	for(i = 0; i < t->vma_cnt; i++)
+		free(t->vma[i]);
+	free(t->vma);
+	t->vma = NULL;
+	t->vma_cnt = t->vma_cap = 0;
 }
 
 void vm_destroy(struct hash *vm) {
@@ -75,10 +274,11 @@ void vm_destroy_func(struct hash_elem *e, void *aux UNUSED) {
 		// 실제로 탑재 된 경우
 		if(true == vme->is_loaded) {
 			struct thread *t = thread_current();
-			// pagedir에서 검색해서 물리 페이지를 해제함
-			palloc_free_page(pagedir_get_page(t->pagedir, vme->vaddr));
-			// pagedir에서 vaddr의 맵핑을 해제
-			pagedir_clear_page(t->pagedir, vme->vaddr);
+			// pagedir에서 검색해서 물리 페이지를 해제함. 프레임을 다른
+			// 프로세스와 공유중일 수 있으므로 free_page로 참조만 놓는다
+			void *kaddr = pagedir_get_page(t->pagedir, vme->vaddr);
+			if(NULL != kaddr)
+				free_page(kaddr);
 		}
 
 		// load_segment에서 malloc을 사용하기 때문에 free로 해제함
@@ -86,7 +286,10 @@ void vm_destroy_func(struct hash_elem *e, void *aux UNUSED) {
 	}
 }
 
-struct page* alloc_page(enum palloc_flags flags) {
+// page구조체를 할당하고 물리 페이지를 붙임. EVICT가 true면 메모리가 부족할
+// 때 다른 페이지를 evict해서라도 확보하고, false면 NULL을 리턴.
+// evict할 수 있는 페이지가 없어도 NULL
+static struct page* __alloc_page(enum palloc_flags flags, bool evict) {
 	struct page *page;
 	page = (struct page *)malloc(sizeof(struct page));			// page구조체를 할당
 	if(NULL == page)																				// malloc실패시
@@ -94,41 +297,96 @@ struct page* alloc_page(enum palloc_flags flags) {
 	page->thread = thread_current();												// page구조체 초기화
 	page->kaddr = NULL;
 	page->vme = NULL;
+	page->pinned = 0;
 
 	// palloc_get_page로 물리 페이지 할당
 	page->kaddr = palloc_get_page(flags);
-	if(NULL == page->kaddr) {											// 아래는 메모리가 부족할 경우임
+	if(NULL == page->kaddr && evict)							// 아래는 메모리가 부족할 경우임
 		page->kaddr = try_to_free_pages(flags);			// 우선 메모리를 확보
+	// evict할 수 있는 페이지도 없으면 실패
+	if(NULL == page->kaddr) {
+		free(page);
+		return NULL;
 	}
 	lock_acquire(&lru_list_lock);
+	frame_ref(page->kaddr);												// 처음 맵핑하는 page
 	add_page_to_lru_list(page);
 	lock_release(&lru_list_lock);
 	return page;
 }
+
+struct page* alloc_page(enum palloc_flags flags) {
+	return __alloc_page(flags, true);
+}
+
+// 남는 프레임이 있을 때만 할당. fault-around처럼 미리 읽어두는 용도라서
+// 다른 페이지를 쫓아내면서까지 할당하지는 않음
+struct page* try_alloc_page(enum palloc_flags flags) {
+	return __alloc_page(flags, false);
+}
 	
-// 시작 주소가 kaddr인 물리 페이지를 삭제
-// 그런거 lru_list에서 못찾으면 아무것도 안함
-void free_page(void *kaddr) {
+// 현재 스레드가 kaddr을 맵핑한 page를 lru_list에서 찾음
+// 프레임이 공유될 수 있으므로 kaddr뿐 아니라 스레드도 비교해야 함
+// lru_list_lock을 잡은 상태에서 호출
+struct page *find_page(void *kaddr) {
 	struct list_elem *e;
-	lock_acquire(&lru_list_lock);		// 아래에서 list_remove를 하므로 lock
+	struct thread *cur = thread_current();
 	for(e = list_begin(&lru_list); e != list_end(&lru_list); e = list_next(e)) {
 		struct page *page = list_entry(e, struct page, lru);
-		// 찾으면 _free_page하고 for문 퇴장
-		if(kaddr == page->kaddr) {
-			//TODO 현재 문제는 아래 함수에서 exit(-1)을 호출
-			__free_page(page);
-			break;
+		if(kaddr == page->kaddr && cur == page->thread)
+			return page;
+	}
+	return NULL;
+}
+
+// 현재 스레드의 유저 페이지 VADDR에 맵핑된 page를 고정하거나(PINNED가 true)
+// 한 번 풀어줌. 고정된 page는 try_to_free_pages가 건너뛰므로, 시스템 콜이
+// 유저 버퍼를 쓰는 동안 fault가 나지 않는다. 고정한 횟수를 세므로 겹치는
+// 버퍼들이 같은 페이지를 고정해도 마지막으로 풀 때까지 고정된 채로 남음.
+// page는 vm_entry에서 바로 찾으므로 lru_list를 뒤지지 않음.
+// 맵핑된 page가 없으면 false
+bool set_page_pinned(void *vaddr, bool pinned) {
+	struct vm_entry *vme = lookup_vme(pg_round_down(vaddr));
+	struct page *page = NULL;
+
+	lock_acquire(&lru_list_lock);
+	if(NULL != vme && vme->is_loaded)
+		page = vme->page;
+	if(NULL != page) {
+		if(pinned)
+			page->pinned++;
+		else {
+			ASSERT(0 < page->pinned);
+			page->pinned--;
 		}
 	}
+	lock_release(&lru_list_lock);
+
+	return NULL != page;
+}
 
+// 시작 주소가 kaddr인 물리 페이지를 삭제
+// 그런거 lru_list에서 못찾으면 아무것도 안함
+void free_page(void *kaddr) {
+	struct page *page;
+	lock_acquire(&lru_list_lock);		// 아래에서 list_remove를 하므로 lock
+	page = find_page(kaddr);
+	if(NULL != page)
+		__free_page(page);
 	lock_release(&lru_list_lock);
 }
 
 // 물리 페이지 page를 해제
+// 다른 page가 같은 프레임을 공유중이면 맵핑만 해제하고 프레임은 남겨둠
 void __free_page(struct page *page) {
-	pagedir_clear_page(page->thread->pagedir, page->vme->vaddr);	// pagedir해제
+	if(NULL != page->vme) {					// vme가 아직 안 붙은 페이지는 맵핑도 없음
+		pagedir_clear_page(page->thread->pagedir, page->vme->vaddr);	// pagedir해제
+		if(page == page->vme->page)
+			page->vme->page = NULL;
+	}
 	del_page_from_lru_list(page);		// lru_list에서 삭제
-	palloc_free_page(page->kaddr);	// alloc_page에서 할당한 것 삭제
+	if(NULL != page->kaddr && 0 == frame_unref(page->kaddr))
+		palloc_free_page(page->kaddr);	// 마지막 참조였으면 프레임도 해제
 	free(page);											// 역시 해제
 }
 
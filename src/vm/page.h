@@ -16,6 +16,9 @@
 #define VM_FILE 1
 #define VM_ANON 2
 
+extern size_t fault_around_max;				// fault-around window의 최댓값(페이지)
+extern size_t stack_limit;						// 유저 스택의 최대 크기(바이트)
+
 // 가상메모리 entry
 struct vm_entry {
 	uint8_t type;									// VM_BIN, VM_FILE, VM_ANON의 타입
@@ -28,13 +31,28 @@ struct vm_entry {
 	size_t read_bytes;						// 가상 페이지에 쓰여진 데이터 크기
 	size_t zero_bytes;						// 0으로 채울 남은 페이지의 바이트
 	size_t swap_slot;							// 스왑 슬롯
+	struct page *page;						// 올라와 있으면 맵핑된 page, 아니면 NULL
 	struct hash_elem elem;				// 해시 테이블 elem
 };
 
+// 가상 주소 영역. 실행 파일의 세그먼트, 스택, mmap 하나가 각각 영역 하나임.
+// 페이지마다의 vm_entry는 미리 만들지 않고 처음 접근할 때 영역을 보고 만든다
+struct vm_area {
+	uint8_t type;									// 영역 안 페이지들의 타입
+	void *start;									// 영역의 시작 주소 (페이지 단위)
+	void *end;										// 영역의 끝 주소 (포함하지 않음)
+	bool writable;								// 영역에 write가능 여부
+	struct file *file;						// 영역과 사상된 파일. 없으면 NULL
+	size_t offset;								// start에 해당하는 파일 오프셋
+	size_t read_bytes;						// 파일에서 읽을 전체 크기. 나머지는 0으로 채움
+	struct mmap_file *mmap_file;	// mmap으로 만든 영역이면 해당 mmap_file
+};
+
 // mmaping 파일
 struct mmap_file {
 	int mapid;										// 맵핑된 아이디
 	struct file* file;						// 맵핑된 파일
+	struct vm_area *vma;					// 맵핑된 영역
 	struct list_elem elem;				// struct thread의 mmap_list의 원소
 	struct list vme_list;					// mmap_file에 해당하는 vme원소들
 };
@@ -44,6 +62,8 @@ struct page {
 	void *kaddr;									// 물리페이지의 시작주소
 	struct vm_entry *vme;					// 물리페이지에 사상된 가상 주소의 vme
 	struct thread *thread;				// 페이지를 사용중인 thread
+	int pinned;										// 고정된 횟수. 0보다 크면 evict하지 않음
+																// (시스템 콜이 사용중)
 	struct list_elem lru;					// 페이지를 관리하는 list의 원소로서
 };
 
@@ -51,11 +71,21 @@ void vm_init(struct hash *vm);
 bool insert_vme(struct hash *vm, struct vm_entry *vme); 
 bool delete_vme(struct hash *vm, struct vm_entry *vme);
 struct vm_entry *find_vme(void *vaddr);
+struct vm_entry *lookup_vme(void *vaddr);
+bool insert_vma(struct vm_area *vma);
+bool delete_vma(struct vm_area *vma);
+bool resize_vma(struct vm_area *vma, void *end);
+struct vm_area *find_vma(void *vaddr);
+bool grow_stack(void *addr, void *esp);
+void vma_destroy(void);
 void vm_destroy(struct hash *vm);
 void vm_destroy_func(struct hash_elem *e, void *aux UNUSED);
 bool load_file(void *kaddr, struct vm_entry *vme); 
 struct page* alloc_page(enum palloc_flags flags);
+struct page* try_alloc_page(enum palloc_flags flags);
 void free_page(void *kaddr);
 void __free_page(struct page *page);
+struct page *find_page(void *kaddr);
+bool set_page_pinned(void *vaddr, bool pinned);
 
 #endif // _VM_PAGE_H_
@@ -2,6 +2,7 @@
 
 #include "vm/swap.h"
 #include "userprog/syscall.h"
+#include "threads/malloc.h"
 
 void swap_init(size_t size) {
 	swap_block = block_get_role(BLOCK_SWAP);		// 스왑 블럭을 가져옴
@@ -51,3 +52,39 @@ size_t swap_out (void *kaddr) {
 	return swap_index;
 }
 	
+
+// used_index 슬롯의 내용을 새 슬롯에 복사하고 새 슬롯의 인덱스를 리턴
+// fork시 자식이 스왑된 페이지를 따로 갖도록 하기 위해 사용
+size_t swap_copy (size_t used_index) {
+	ASSERT(NULL != swap_block && NULL != swap_bitmap);
+	int i;					// for loop
+	void *bounce = malloc(BLOCK_SECTOR_SIZE);		// 섹터 하나짜리 버퍼
+	if(NULL == bounce)
+		return BITMAP_ERROR;
+
+	// 새 슬롯만 잡아두고 복사는 lock을 놓고 함. 두 슬롯 모두 사용중으로
+	// 표시되어 있으므로 그동안 다른 스레드가 건드리지 않음
+	lock_acquire(&swap_lock);
+	ASSERT(0 != bitmap_test(swap_bitmap, used_index));
+	size_t swap_index = bitmap_scan_and_flip(swap_bitmap, 0, 1, 0);
+	lock_release(&swap_lock);
+
+	if(BITMAP_ERROR != swap_index) {
+		for(i = 0; i < 8; i++) {
+			block_read(swap_block, used_index * 8 + i, bounce);
+			block_write(swap_block, swap_index * 8 + i, bounce);
+		}
+	}
+
+	free(bounce);
+	return swap_index;
+}
+
+// 스왑 슬롯 used_index를 읽지 않고 반납. 스왑된 페이지를 버릴 때 사용
+void swap_free (size_t used_index) {
+	ASSERT(NULL != swap_block && NULL != swap_bitmap);
+	lock_acquire(&swap_lock);
+	ASSERT(0 != bitmap_test(swap_bitmap, used_index));
+	bitmap_reset(swap_bitmap, used_index);
+	lock_release(&swap_lock);
+}
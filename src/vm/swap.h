@@ -12,6 +12,8 @@
 void swap_init(size_t size);
 void swap_in(size_t used_index, void *kaddr);
 size_t swap_out(void *kaddr);
+size_t swap_copy(size_t used_index);
+void swap_free(size_t used_index);
 
 // 아래는 전역변수들
 struct lock swap_lock;				// 아래를 위한 lock